@@ -1,24 +1,13 @@
 #include <cassert>
 
+#include "openpilot/cereal/messaging/bridge_stats.h"
+#include "openpilot/cereal/messaging/bridge_whitelist.h"
 #include "openpilot/cereal/messaging/msgq_to_zmq.h"
 #include "openpilot/cereal/services.h"
 #include "common/util.h"
 
 ExitHandler do_exit;
 
-static std::vector<std::string> get_services(const std::string &whitelist_str, bool zmq_to_msgq) {
-  std::vector<std::string> service_list;
-  for (const auto& it : services) {
-    std::string name = it.second.name;
-    bool in_whitelist = whitelist_str.find(name) != std::string::npos;
-    if (zmq_to_msgq && !in_whitelist) {
-      continue;
-    }
-    service_list.push_back(name);
-  }
-  return service_list;
-}
-
 void msgq_to_zmq(const std::vector<std::string> &endpoints, const std::string &ip) {
   MsgqToZmq bridge;
   bridge.run(endpoints, ip);
@@ -28,9 +17,18 @@ void zmq_to_msgq(const std::vector<std::string> &endpoints, const std::string &i
   auto poller = std::make_unique<BridgeZmqPoller>();
   auto pub_context = std::make_unique<Context>();
   auto sub_context = std::make_unique<BridgeZmqContext>();
-  std::map<BridgeZmqSubSocket *, PubSocket *> sub2pub;
+  std::map<BridgeZmqSubSocket *, std::pair<PubSocket *, size_t>> sub2pub;  // pub socket, stats index
+  BridgeStats stats(endpoints, util::getenv("BRIDGE_STATS_INTERVAL", 10.0f));
 
-  for (auto endpoint : endpoints) {
+  // must match the sender, see bridge_stream.h
+  BridgeStreamConfig stream_config = BridgeStreamConfig::fromEnv();
+  std::unique_ptr<BridgeStreamDecoder> decoder;
+  if (stream_config.enabled) {
+    decoder = std::make_unique<BridgeStreamDecoder>(stream_config);
+  }
+
+  for (size_t i = 0; i < endpoints.size(); ++i) {
+    const std::string &endpoint = endpoints[i];
     auto pub_sock = new PubSocket();
     auto sub_sock = new BridgeZmqSubSocket();
     size_t queue_size = services.at(endpoint).queue_size;
@@ -38,22 +36,32 @@ void zmq_to_msgq(const std::vector<std::string> &endpoints, const std::string &i
     sub_sock->connect(sub_context.get(), endpoint, ip, false);
 
     poller->registerSocket(sub_sock);
-    sub2pub[sub_sock] = pub_sock;
+    sub2pub[sub_sock] = {pub_sock, i};
   }
 
   while (!do_exit) {
+    stats.report();
     for (auto sub_sock : poller->poll(100)) {
       std::unique_ptr<Message> msg(sub_sock->receive(true));
-      if (msg) {
-        sub2pub[sub_sock]->sendMessage(msg.get());
+      if (!msg) continue;
+
+      auto [pub_sock, index] = sub2pub[sub_sock];
+      auto &c = stats[index];
+      c.bytes += msg->getSize();
+      if (!decoder) {
+        pub_sock->sendMessage(msg.get());
+        c.msgs++;
+      } else if (!decoder->decode(msg->getData(), msg->getSize(), [&](char *data, size_t size) { pub_sock->send(data, size); c.msgs++; })) {
+        printf("dropping malformed frame (%zu bytes)\n", msg->getSize());
+        c.drops++;
       }
     }
   }
 
   // Clean up allocated sockets
-  for (auto &[sub_sock, pub_sock] : sub2pub) {
+  for (auto &[sub_sock, pub] : sub2pub) {
     delete sub_sock;
-    delete pub_sock;
+    delete pub.first;
   }
 }
 
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/timing.h"
+
+// Per service counters, bumped by the forwarding threads and printed every BRIDGE_STATS_INTERVAL
+// seconds (default 10, 0 disables) by the main thread. Only services with traffic are listed.
+class BridgeStats {
+public:
+  struct Counters {
+    std::atomic<uint64_t> msgs = 0, bytes = 0, drops = 0;
+  };
+
+  BridgeStats(const std::vector<std::string> &services, double interval_s)
+      : names(services), counters(std::make_unique<Counters[]>(services.size())),
+        last(services.size()), interval_ns(interval_s * 1e9), last_report_ns(nanos_since_boot()) {}
+
+  Counters &operator[](size_t i) { return counters[i]; }
+
+  void report() {
+    const uint64_t now = nanos_since_boot();
+    if (interval_ns == 0 || now - last_report_ns < interval_ns) return;
+
+    const double dt = (now - last_report_ns) / 1e9;
+    last_report_ns = now;
+    for (size_t i = 0; i < names.size(); ++i) {
+      Snapshot cur = {counters[i].msgs.load(std::memory_order_relaxed), counters[i].bytes.load(std::memory_order_relaxed),
+                      counters[i].drops.load(std::memory_order_relaxed)};
+      if (cur.msgs != last[i].msgs || cur.drops != last[i].drops) {
+        printf("[%s] %.1f msgs/s, %.1f KB/s, %lu drops\n", names[i].c_str(), (cur.msgs - last[i].msgs) / dt,
+               (cur.bytes - last[i].bytes) / dt / 1024.0, (unsigned long)(cur.drops - last[i].drops));
+      }
+      last[i] = cur;
+    }
+  }
+
+private:
+  struct Snapshot {
+    uint64_t msgs = 0, bytes = 0, drops = 0;
+  };
+
+  std::vector<std::string> names;
+  std::unique_ptr<Counters[]> counters;
+  std::vector<Snapshot> last;  // only touched by report()
+  uint64_t interval_ns;
+  uint64_t last_report_ns;
+};
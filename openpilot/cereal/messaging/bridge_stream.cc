@@ -0,0 +1,179 @@
+#include "openpilot/cereal/messaging/bridge_stream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "common/util.h"
+
+constexpr uint32_t FRAME_MAGIC = 0x31534242;  // "BBS1"
+constexpr int COMPRESSION_LEVEL = 3;
+constexpr size_t MAX_FRAME_CONTENT_SIZE = 64 * 1024 * 1024;
+
+struct FrameHeader {
+  uint32_t magic;
+  uint32_t count;
+};
+
+BridgeStreamConfig BridgeStreamConfig::fromEnv() {
+  BridgeStreamConfig config;
+  config.enabled = getenv("BRIDGE_COMPRESS") != nullptr;
+  config.window_ms = std::max(util::getenv("BRIDGE_COMPRESS_WINDOW_MS", config.window_ms), 0);
+
+  std::string dict_path = util::getenv("BRIDGE_ZSTD_DICT");
+  if (config.enabled && !dict_path.empty()) {
+    config.dict = util::read_file(dict_path);
+    if (config.dict.empty()) {
+      // the other end can't decode anything without the same dictionary
+      printf("Failed to read zstd dictionary [%s]\n", dict_path.c_str());
+      exit(1);
+    }
+  }
+
+  std::stringstream limits(util::getenv("BRIDGE_RATE_LIMIT"));
+  std::string entry;
+  while (std::getline(limits, entry, ',')) {
+    auto sep = entry.find(':');
+    float hz = sep == std::string::npos ? 0 : std::atof(entry.c_str() + sep + 1);
+    if (hz <= 0) {
+      printf("Ignoring invalid rate limit [%s]\n", entry.c_str());
+      continue;
+    }
+    config.rate_limits[util::strip(entry.substr(0, sep))] = hz;
+  }
+  return config;
+}
+
+BridgeStreamEncoder::BridgeStreamEncoder(const BridgeStreamConfig &config, const std::string &service)
+    : window_ns_(config.window_ms * 1000000ULL) {
+  if (auto it = config.rate_limits.find(service); it != config.rate_limits.end()) {
+    period_ns_ = 1e9 / it->second;
+  }
+
+  cctx_ = ZSTD_createCCtx();
+  assert(cctx_);
+  if (!config.dict.empty()) {
+    cdict_ = ZSTD_createCDict(config.dict.data(), config.dict.size(), COMPRESSION_LEVEL);
+    assert(cdict_);
+    size_t ret = ZSTD_CCtx_refCDict(cctx_, cdict_);
+    assert(!ZSTD_isError(ret));
+  } else {
+    size_t ret = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, COMPRESSION_LEVEL);
+    assert(!ZSTD_isError(ret));
+  }
+  // a damaged frame fails to decompress instead of handing out garbage that happens to parse
+  size_t ret = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_checksumFlag, 1);
+  assert(!ZSTD_isError(ret));
+}
+
+BridgeStreamEncoder::~BridgeStreamEncoder() {
+  ZSTD_freeCCtx(cctx_);
+  ZSTD_freeCDict(cdict_);
+}
+
+bool BridgeStreamEncoder::add(const char *data, size_t size, uint64_t now_ns) {
+  if (period_ns_ > 0) {
+    if (now_ns < next_allowed_ns_) {
+      ++dropped_;
+      return false;
+    }
+    // stay on the period grid while messages keep coming, so jitter in the source
+    // rate doesn't turn every other message into a drop. restart it after a gap
+    next_allowed_ns_ = (now_ns - next_allowed_ns_ < period_ns_ / 2 ? next_allowed_ns_ : now_ns) + period_ns_;
+  }
+
+  if (count_ == 0) {
+    window_start_ns_ = now_ns;
+    raw_.clear();
+  }
+  uint32_t len = size;
+  raw_.insert(raw_.end(), (const char *)&len, (const char *)&len + sizeof(len));
+  raw_.insert(raw_.end(), data, data + size);
+  ++count_;
+  return true;
+}
+
+const std::vector<char> &BridgeStreamEncoder::flush() {
+  frame_.clear();
+  if (count_ == 0) return frame_;
+
+  FrameHeader header = {FRAME_MAGIC, count_};
+  frame_.resize(sizeof(header) + ZSTD_compressBound(raw_.size()));
+  memcpy(frame_.data(), &header, sizeof(header));
+  size_t size = ZSTD_compress2(cctx_, frame_.data() + sizeof(header), frame_.size() - sizeof(header), raw_.data(), raw_.size());
+  if (ZSTD_isError(size)) {
+    printf("dropping %u messages, compression failed: %s\n", count_, ZSTD_getErrorName(size));
+    dropped_ += count_;
+    frame_.clear();
+  } else {
+    frame_.resize(sizeof(header) + size);
+  }
+
+  count_ = 0;
+  return frame_;
+}
+
+BridgeStreamDecoder::BridgeStreamDecoder(const BridgeStreamConfig &config) {
+  dctx_ = ZSTD_createDCtx();
+  assert(dctx_);
+  if (!config.dict.empty()) {
+    ddict_ = ZSTD_createDDict(config.dict.data(), config.dict.size());
+    assert(ddict_);
+    size_t ret = ZSTD_DCtx_refDDict(dctx_, ddict_);
+    assert(!ZSTD_isError(ret));
+  }
+}
+
+BridgeStreamDecoder::~BridgeStreamDecoder() {
+  ZSTD_freeDCtx(dctx_);
+  ZSTD_freeDDict(ddict_);
+}
+
+bool BridgeStreamDecoder::decode(const char *data, size_t size, const std::function<void(char *data, size_t size)> &f) {
+  FrameHeader header;
+  if (size < sizeof(header)) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != FRAME_MAGIC) return false;
+  data += sizeof(header);
+  size -= sizeof(header);
+
+  unsigned int frame_dict = ZSTD_getDictID_fromFrame(data, size);
+  if (frame_dict != (ddict_ ? ZSTD_getDictID_fromDDict(ddict_) : 0)) {
+    printf("bridge frame needs zstd dictionary %u, check BRIDGE_ZSTD_DICT on both ends\n", frame_dict);
+    return false;
+  }
+
+  unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+      content_size > MAX_FRAME_CONTENT_SIZE) {
+    return false;
+  }
+  raw_.resize(content_size);
+  size_t ret = ZSTD_decompressDCtx(dctx_, raw_.data(), raw_.size(), data, size);
+  if (ZSTD_isError(ret) || ret != content_size) return false;
+
+  // validate the whole frame before handing anything out
+  size_t offset = 0;
+  for (uint32_t i = 0; i < header.count; ++i) {
+    uint32_t len;
+    if (raw_.size() - offset < sizeof(len)) return false;
+    memcpy(&len, raw_.data() + offset, sizeof(len));
+    offset += sizeof(len);
+    if (raw_.size() - offset < len) return false;
+    offset += len;
+  }
+  if (offset != raw_.size()) return false;
+
+  offset = 0;
+  for (uint32_t i = 0; i < header.count; ++i) {
+    uint32_t len;
+    memcpy(&len, raw_.data() + offset, sizeof(len));
+    offset += sizeof(len);
+    f(raw_.data() + offset, len);
+    offset += len;
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <zstd.h>
+
+// Opt-in compressed transport for the bridge, for bandwidth bound links. Set on both ends:
+//   BRIDGE_COMPRESS=1                 enable
+//   BRIDGE_COMPRESS_WINDOW_MS=50      how long messages of a service are collected into one frame
+//   BRIDGE_ZSTD_DICT=<path>           shared zstd dictionary, e.g. from `zstd --train` on raw messages
+//                                     dumped one per file. both ends must load the same one
+//   BRIDGE_RATE_LIMIT=can:20,carState:10   max messages per second per service, sender side
+// Each frame is one ZMQ message: a small header followed by the zstd compressed messages, each
+// prefixed with its size. Not understood by plain ZMQ subscribers, only by the receiving bridge.
+struct BridgeStreamConfig {
+  bool enabled = false;
+  int window_ms = 50;
+  std::string dict;
+  std::map<std::string, float> rate_limits;
+
+  static BridgeStreamConfig fromEnv();
+};
+
+class BridgeStreamEncoder {
+public:
+  BridgeStreamEncoder(const BridgeStreamConfig &config, const std::string &service);
+  ~BridgeStreamEncoder();
+
+  // false if the message was dropped by the rate limit
+  bool add(const char *data, size_t size, uint64_t now_ns);
+  // pending messages have waited a full window
+  bool ready(uint64_t now_ns) const { return count_ > 0 && now_ns - window_start_ns_ >= window_ns_; }
+  // compresses the pending messages into a frame, valid until the next call. empty if nothing is
+  // pending, or if compression failed and the pending messages were dropped
+  const std::vector<char> &flush();
+
+  size_t dropped() const { return dropped_; }
+
+private:
+  uint64_t window_ns_;
+  uint64_t period_ns_ = 0;  // rate limit, 0 for none
+  uint64_t next_allowed_ns_ = 0;
+  uint64_t window_start_ns_ = 0;
+  uint32_t count_ = 0;
+  size_t dropped_ = 0;
+  std::vector<char> raw_, frame_;
+  ZSTD_CCtx *cctx_ = nullptr;
+  ZSTD_CDict *cdict_ = nullptr;
+};
+
+class BridgeStreamDecoder {
+public:
+  BridgeStreamDecoder(const BridgeStreamConfig &config);
+  ~BridgeStreamDecoder();
+
+  // calls f for every message in the frame. false if the frame is malformed
+  bool decode(const char *data, size_t size, const std::function<void(char *data, size_t size)> &f);
+
+private:
+  std::vector<char> raw_;
+  ZSTD_DCtx *dctx_ = nullptr;
+  ZSTD_DDict *ddict_ = nullptr;
+};
@@ -0,0 +1,67 @@
+#include "openpilot/cereal/messaging/bridge_whitelist.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <regex>
+#include <sstream>
+
+#include "openpilot/cereal/services.h"
+
+struct WhitelistEntry {
+  std::string pattern;
+  std::optional<std::regex> regex;
+  bool used = false;
+
+  bool matches(const std::string &name) const {
+    if (regex) return std::regex_search(name, *regex);
+    if (pattern.find_first_of("*?[") != std::string::npos) return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+    return pattern == name;
+  }
+};
+
+static std::vector<WhitelistEntry> parse_whitelist(std::string whitelist_str) {
+  std::replace(whitelist_str.begin(), whitelist_str.end(), ',', ' ');
+  std::stringstream ss(whitelist_str);
+  std::vector<WhitelistEntry> whitelist;
+  for (std::string pattern; ss >> pattern;) {
+    auto &entry = whitelist.emplace_back(WhitelistEntry{pattern});
+    if (pattern.size() > 2 && pattern.front() == '/' && pattern.back() == '/') {
+      try {
+        entry.regex = std::regex(pattern.substr(1, pattern.size() - 2));
+      } catch (const std::regex_error &e) {
+        printf("invalid whitelist regex [%s]: %s\n", pattern.c_str(), e.what());
+        exit(1);
+      }
+    }
+  }
+  return whitelist;
+}
+
+std::vector<std::string> get_services(const std::string &whitelist_str, bool zmq_to_msgq) {
+  auto whitelist = parse_whitelist(whitelist_str);
+  std::vector<std::string> service_list;
+  for (const auto& it : services) {
+    std::string name = it.second.name;
+    bool in_whitelist = false;
+    for (auto &entry : whitelist) {
+      if (entry.matches(name)) {
+        in_whitelist = entry.used = true;
+      }
+    }
+    if (zmq_to_msgq && !in_whitelist) {
+      continue;
+    }
+    service_list.push_back(name);
+  }
+
+  for (const auto &entry : whitelist) {
+    if (!entry.used) {
+      printf("whitelist entry [%s] matches no service\n", entry.pattern.c_str());
+    }
+  }
+  return service_list;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// services the bridge forwards. whitelist entries are separated by commas or spaces, each one is an
+// exact service name, a glob like "car*" or a regex between slashes like "/^(can|sendcan)$/".
+// msgq -> zmq forwards every service, zmq -> msgq only the whitelisted ones
+std::vector<std::string> get_services(const std::string &whitelist_str, bool zmq_to_msgq);
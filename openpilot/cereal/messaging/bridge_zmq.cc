@@ -127,9 +127,9 @@ int BridgeZmqPubSocket::connect(BridgeZmqContext *context, std::string endpoint,
   return zmq_bind(sock, full_endpoint.c_str());
 }
 
-int BridgeZmqPubSocket::sendMessage(Message *message) {
+int BridgeZmqPubSocket::sendMessage(Message *message, bool more) {
   assert(pid == getpid());
-  return zmq_send(sock, message->getData(), message->getSize(), ZMQ_DONTWAIT);
+  return zmq_send(sock, message->getData(), message->getSize(), ZMQ_DONTWAIT | (more ? ZMQ_SNDMORE : 0));
 }
 
 int BridgeZmqPubSocket::send(char *data, size_t size) {
@@ -48,7 +48,8 @@ private:
 class BridgeZmqPubSocket {
 public:
   int connect(BridgeZmqContext *context, std::string endpoint, bool check_endpoint = true);
-  int sendMessage(Message *message);
+  // more: further parts of the same multipart message follow
+  int sendMessage(Message *message, bool more = false);
   int send(char *data, size_t size);
   void *getRawSocket() { return sock; }
   ~BridgeZmqPubSocket();
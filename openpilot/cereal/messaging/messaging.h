@@ -1,8 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
@@ -12,8 +18,31 @@
 #include "common/timing.h"
 #include "msgq/ipc.h"
 
+class AlignedBuffer {
+public:
+  kj::ArrayPtr<const capnp::word> align(const char *data, const size_t size) {
+    words_size = (size + sizeof(capnp::word) - 1) / sizeof(capnp::word);
+    if (aligned_buf.size() < words_size) {
+      aligned_buf = kj::heapArray<capnp::word>(words_size < 512 ? 512 : words_size);
+    }
+    memcpy(aligned_buf.begin(), data, size);
+    return aligned_buf.slice(0, words_size);
+  }
+  inline kj::ArrayPtr<const capnp::word> align(Message *m) {
+    return align(m->getData(), m->getSize());
+  }
+private:
+  kj::Array<capnp::word> aligned_buf;
+  size_t words_size;
+};
+
 class SubMaster {
 public:
+  // resolve a service once with handle(), then use the handle overloads in hot loops to skip the name lookup
+  struct Handle {
+    size_t index;
+  };
+
   SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll = {},
             const char *address = nullptr, const std::vector<const char *> &ignore_alive = {});
   void update(int timeout = 1000);
@@ -25,24 +54,113 @@ public:
   ~SubMaster();
 
   uint64_t frame = 0;
-  bool updated(const char *name) const;
-  bool alive(const char *name) const;
-  bool valid(const char *name) const;
-  uint64_t rcv_frame(const char *name) const;
-  uint64_t rcv_time(const char *name) const;
-  cereal::Event::Reader &operator[](const char *name) const;
+  Handle handle(const char *name) const;
+  inline bool updated(Handle h) const { return messages_[h.index].updated; }
+  inline bool alive(Handle h) const { return messages_[h.index].alive; }
+  inline bool valid(Handle h) const { return messages_[h.index].valid; }
+  inline uint64_t rcv_frame(Handle h) const { return messages_[h.index].rcv_frame; }
+  inline uint64_t rcv_time(Handle h) const { return messages_[h.index].rcv_time; }
+  inline const cereal::Event::Reader &operator[](Handle h) const { return messages_[h.index].event; }
+
+  inline bool updated(const char *name) const { return updated(handle(name)); }
+  inline bool alive(const char *name) const { return alive(handle(name)); }
+  inline bool valid(const char *name) const { return valid(handle(name)); }
+  inline uint64_t rcv_frame(const char *name) const { return rcv_frame(handle(name)); }
+  inline uint64_t rcv_time(const char *name) const { return rcv_time(handle(name)); }
+  inline const cereal::Event::Reader &operator[](const char *name) const { return (*this)[handle(name)]; }
 
 private:
+  struct SubMessage {
+    std::string name;
+    SubSocket *socket = nullptr;
+    float freq = 0.0f;
+    bool updated = false, alive = false, valid = false, ignore_alive;
+    uint64_t rcv_time = 0, rcv_frame = 0;
+    void *allocated_msg_reader = nullptr;
+    bool is_polled = false;
+    capnp::FlatArrayMessageReader *msg_reader = nullptr;
+    AlignedBuffer aligned_buf;
+    std::unique_ptr<Message> msg;  // backs msg_reader when it reads the received buffer in place
+    cereal::Event::Reader event;
+
+    kj::ArrayPtr<const capnp::word> attach(Message *received);
+  };
+
   bool all_(const std::vector<const char *> &service_list, bool valid, bool alive);
+  void set_event_(SubMessage &m, const cereal::Event::Reader &event, uint64_t current_time);
+  void update_alive_(uint64_t current_time);
   Poller *poller_ = nullptr;
-  struct SubMessage;
-  std::map<SubSocket *, SubMessage *> messages_;
-  std::map<std::string, SubMessage *> services_;
+  std::vector<SubMessage> messages_;
+  std::unordered_map<SubSocket *, size_t> sockets_;
+  std::map<std::string, size_t, std::less<>> services_;
 };
 
-class MessageBuilder : public capnp::MallocMessageBuilder {
+// Per thread scratch space for MessageBuilder: a zeroed first segment handed to capnp and the output
+// buffer for toBytes(). Both grow to fit the largest message seen (up to MAX_WORDS), so steady state
+// publishing doesn't touch the heap. One builder per thread holds it at a time, others use the heap.
+class MessageArena {
 public:
-  MessageBuilder() = default;
+  static constexpr size_t MAX_WORDS = 128 * 1024;
+
+  static MessageArena *acquire() {
+    thread_local MessageArena arena;
+    if (arena.in_use_) return nullptr;
+    arena.in_use_ = true;
+    if (arena.segment_.size() < arena.segment_words_) {
+      arena.segment_ = zeroed(arena.segment_words_);
+    }
+    return &arena;
+  }
+
+  // capnp zeroes the used part of the segment when the builder is destroyed, before this is called
+  void release(size_t message_words) {
+    segment_words_ = std::min(std::max(segment_words_, message_words), MAX_WORDS);
+    in_use_ = false;
+  }
+
+  kj::ArrayPtr<capnp::word> segment() { return segment_; }
+
+  kj::ArrayPtr<capnp::word> output(size_t words) {
+    if (output_.size() < words) output_ = kj::heapArray<capnp::word>(words);
+    return output_.slice(0, words);
+  }
+
+  static kj::Array<capnp::word> zeroed(size_t words) {
+    auto array = kj::heapArray<capnp::word>(words);
+    memset(array.begin(), 0, array.asBytes().size());
+    return array;
+  }
+
+private:
+  bool in_use_ = false;
+  size_t segment_words_ = capnp::SUGGESTED_FIRST_SEGMENT_WORDS;
+  kj::Array<capnp::word> segment_, output_;
+};
+
+// base of MessageBuilder, so the arena is taken before capnp gets its segment and returned after capnp is done with it
+class MessageArenaLease {
+protected:
+  MessageArenaLease() : arena_(MessageArena::acquire()) {
+    if (!arena_) own_segment_ = MessageArena::zeroed(capnp::SUGGESTED_FIRST_SEGMENT_WORDS);
+  }
+  ~MessageArenaLease() {
+    if (arena_) arena_->release(message_words_);
+  }
+  kj::ArrayPtr<capnp::word> segment() { return arena_ ? arena_->segment() : own_segment_.asPtr(); }
+
+  MessageArena *arena_;
+  kj::Array<capnp::word> own_segment_;
+  size_t message_words_ = 0;
+};
+
+// Builders should live on the thread that created them, the arena they hold is thread local.
+class MessageBuilder : private MessageArenaLease, public capnp::MallocMessageBuilder {
+public:
+  MessageBuilder() : capnp::MallocMessageBuilder(segment()) {}
+
+  ~MessageBuilder() {
+    for (auto words : getSegmentsForOutput()) message_words_ += words.size();
+  }
 
   cereal::Event::Builder initEvent(bool valid = true) {
     cereal::Event::Builder event = initRoot<cereal::Event>();
@@ -51,9 +169,20 @@ public:
     return event;
   }
 
+  // valid until the builder is destroyed or toBytes() is called again
   kj::ArrayPtr<capnp::byte> toBytes() {
-    heapArray_ = capnp::messageToFlatArray(*this);
-    return heapArray_.asBytes();
+    auto segments = getSegmentsForOutput();
+    const size_t words = capnp::computeSerializedSizeInWords(segments);
+    kj::ArrayPtr<capnp::word> out;
+    if (arena_ && words <= MessageArena::MAX_WORDS) {
+      out = arena_->output(words);
+    } else {
+      heapArray_ = kj::heapArray<capnp::word>(words);
+      out = heapArray_;
+    }
+    kj::ArrayOutputStream stream(out.asBytes());
+    capnp::writeMessage(stream, segments);
+    return out.asBytes();
   }
 
   size_t getSerializedSize() {
@@ -74,29 +203,26 @@ private:
 
 class PubMaster {
 public:
+  // resolved once at init, send by handle or by event type skips the name lookup
+  struct Handle {
+    size_t index;
+  };
+
   PubMaster(const std::vector<const char *> &service_list);
-  inline int send(const char *name, capnp::byte *data, size_t size) { return sockets_.at(name)->send((char *)data, size); }
-  int send(const char *name, MessageBuilder &msg);
-  ~PubMaster();
+  Handle handle(const char *name) const;
+  Handle handle(cereal::Event::Which which) const;
 
-private:
-  std::map<std::string, PubSocket *> sockets_;
-};
+  inline int send(Handle h, capnp::byte *data, size_t size) { return sockets_[h.index]->send((char *)data, size); }
+  int send(Handle h, MessageBuilder &msg);
+  inline int send(cereal::Event::Which which, capnp::byte *data, size_t size) { return send(handle(which), data, size); }
+  inline int send(cereal::Event::Which which, MessageBuilder &msg) { return send(handle(which), msg); }
+  inline int send(const char *name, capnp::byte *data, size_t size) { return send(handle(name), data, size); }
+  inline int send(const char *name, MessageBuilder &msg) { return send(handle(name), msg); }
+  ~PubMaster();
 
-class AlignedBuffer {
-public:
-  kj::ArrayPtr<const capnp::word> align(const char *data, const size_t size) {
-    words_size = size / sizeof(capnp::word) + 1;
-    if (aligned_buf.size() < words_size) {
-      aligned_buf = kj::heapArray<capnp::word>(words_size < 512 ? 512 : words_size);
-    }
-    memcpy(aligned_buf.begin(), data, size);
-    return aligned_buf.slice(0, words_size);
-  }
-  inline kj::ArrayPtr<const capnp::word> align(Message *m) {
-    return align(m->getData(), m->getSize());
-  }
 private:
-  kj::Array<capnp::word> aligned_buf;
-  size_t words_size;
+  static constexpr size_t NOT_PUBLISHED = SIZE_MAX;
+  std::vector<PubSocket *> sockets_;
+  std::map<std::string, size_t, std::less<>> services_;
+  std::vector<size_t> which_;  // cereal::Event::Which -> socket index
 };
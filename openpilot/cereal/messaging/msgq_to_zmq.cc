@@ -1,14 +1,19 @@
 #include "openpilot/cereal/messaging/msgq_to_zmq.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <map>
 
 #include "openpilot/cereal/services.h"
+#include "common/timing.h"
 #include "common/util.h"
 
 extern ExitHandler do_exit;
 
 // Max messages to process per socket per poll
 constexpr int MAX_MESSAGES_PER_SOCKET = 50;
+constexpr int MAX_SHARDS = 4;
 
 static std::string recv_zmq_msg(void *sock) {
   zmq_msg_t msg;
@@ -24,62 +29,202 @@ static std::string recv_zmq_msg(void *sock) {
 void MsgqToZmq::run(const std::vector<std::string> &endpoints, const std::string &ip) {
   zmq_context = std::make_unique<BridgeZmqContext>();
   msgq_context = std::make_unique<Context>();
+  // BRIDGE_BATCH=1 sends everything drained from a socket in one go as a ZMQ multipart message.
+  // receivers still see one message per part, but must not use ZMQ_CONFLATE.
+  batch = getenv("BRIDGE_BATCH") != nullptr;
+  stream_config = BridgeStreamConfig::fromEnv();
+  stats = std::make_unique<BridgeStats>(endpoints, util::getenv("BRIDGE_STATS_INTERVAL", 10.0f));
 
   // Create ZMQPubSockets for each endpoint
-  for (const auto &endpoint : endpoints) {
-    auto &socket_pair = socket_pairs.emplace_back();
-    socket_pair.endpoint = endpoint;
+  socket_pairs.resize(endpoints.size());
+  for (int i = 0; i < endpoints.size(); ++i) {
+    auto &socket_pair = socket_pairs[i];
+    socket_pair.endpoint = endpoints[i];
     socket_pair.pub_sock = std::make_unique<BridgeZmqPubSocket>();
-    int ret = socket_pair.pub_sock->connect(zmq_context.get(), endpoint);
+    int ret = socket_pair.pub_sock->connect(zmq_context.get(), endpoints[i]);
     if (ret != 0) {
-      printf("Failed to create ZMQ publisher for [%s]: %s\n", endpoint.c_str(), zmq_strerror(zmq_errno()));
+      printf("Failed to create ZMQ publisher for [%s]: %s\n", endpoints[i].c_str(), zmq_strerror(zmq_errno()));
       return;
     }
   }
+  if (socket_pairs.empty()) return;
 
-  // Start ZMQ monitoring thread to monitor socket events
-  std::thread thread(&MsgqToZmq::zmqMonitorThread, this);
+  // Set up ZMQ monitor for each pub socket, before the pub sockets move to their shard threads
+  std::vector<void *> monitor_sockets;
+  for (int i = 0; i < socket_pairs.size(); ++i) {
+    std::string addr = "inproc://op-bridge-monitor-" + std::to_string(i);
+    zmq_socket_monitor(socket_pairs[i].pub_sock->getRawSocket(), addr.c_str(), ZMQ_EVENT_ACCEPTED | ZMQ_EVENT_DISCONNECTED);
+
+    void *monitor_socket = zmq_socket(zmq_context->getRawContext(), ZMQ_PAIR);
+    zmq_connect(monitor_socket, addr.c_str());
+    monitor_sockets.push_back(monitor_socket);
+  }
+
+  // Spread endpoints over the shards round robin, so busy services rarely share a thread
+  const int num_shards = std::clamp((int)std::thread::hardware_concurrency(), 1, std::min(MAX_SHARDS, (int)socket_pairs.size()));
+  for (int i = 0; i < num_shards; ++i) {
+    shards.push_back(std::make_unique<Shard>());
+  }
+  for (int i = 0; i < socket_pairs.size(); ++i) {
+    shards[i % num_shards]->pairs.push_back(&socket_pairs[i]);
+  }
+  for (auto &shard : shards) {
+    shard->thread = std::thread(&MsgqToZmq::shardThread, this, std::ref(*shard));
+  }
+
+  // Subscribe and unsubscribe as clients come and go, until exit
+  monitorClients(monitor_sockets);
+
+  for (auto &shard : shards) {
+    shard->cv.notify_one();
+    shard->thread.join();
+  }
+
+  // Clean up monitor sockets
+  for (int i = 0; i < monitor_sockets.size(); ++i) {
+    zmq_socket_monitor(socket_pairs[i].pub_sock->getRawSocket(), nullptr, 0);
+    zmq_close(monitor_sockets[i]);
+  }
+}
+
+void MsgqToZmq::shardThread(Shard &shard) {
+  util::set_thread_name("bridge_forward");
+
+  auto poller = std::make_unique<MSGQPoller>();
+  std::map<SubSocket *, SocketPair *> sub2pair;
+  // wake up at least once per window, so quiet services still get their frames out on time
+  const int poll_timeout = stream_config.enabled ? std::clamp(stream_config.window_ms, 1, 100) : 100;
 
-  // Main loop for processing messages
   while (!do_exit) {
+    std::vector<std::pair<SocketPair *, bool>> pending;
     {
-      std::unique_lock lk(mutex);
-      cv.wait(lk, [this]() { return do_exit || !sub2pub.empty(); });
-      if (do_exit) break;
-
-      for (auto sub_sock : msgq_poller->poll(100)) {
-        // Process messages for each socket
-        BridgeZmqPubSocket *pub_sock = sub2pub.at(sub_sock);
-        for (int i = 0; i < MAX_MESSAGES_PER_SOCKET; ++i) {
-          auto msg = std::unique_ptr<Message>(sub_sock->receive(true));
-          if (!msg) break;
-
-          while (pub_sock->sendMessage(msg.get()) == -1) {
-            if (errno != EINTR) break;
-          }
+      std::unique_lock lk(shard.mutex);
+      if (sub2pair.empty()) {
+        shard.cv.wait_for(lk, std::chrono::milliseconds(100), [&]() { return do_exit || !shard.pending.empty(); });
+      }
+      pending.swap(shard.pending);
+    }
+
+    // msgq signals readers on the thread that connected them, so subscribing happens here
+    bool removed = false;
+    for (auto &[pair, subscribe] : pending) {
+      if (subscribe && !pair->sub_sock) {
+        pair->sub_sock = std::make_unique<MSGQSubSocket>();
+        size_t queue_size = services.at(pair->endpoint).queue_size;
+        pair->sub_sock->connect(msgq_context.get(), pair->endpoint, "127.0.0.1", false, true, queue_size);
+        poller->registerSocket(pair->sub_sock.get());
+        sub2pair[pair->sub_sock.get()] = pair;
+        if (stream_config.enabled) {
+          pair->encoder = std::make_unique<BridgeStreamEncoder>(stream_config, pair->endpoint);
         }
+      } else if (!subscribe && pair->sub_sock) {
+        sub2pair.erase(pair->sub_sock.get());
+        pair->sub_sock.reset(nullptr);
+        pair->encoder.reset(nullptr);
+        removed = true;
+      }
+    }
+    if (removed) {
+      // MSGQPoller can't unregister, rebuild it from this shard's remaining sockets
+      poller = std::make_unique<MSGQPoller>();
+      for (auto &[sub_sock, pair] : sub2pair) {
+        poller->registerSocket(sub_sock);
+      }
+    }
+
+    if (sub2pair.empty()) continue;
+    for (auto sub_sock : poller->poll(poll_timeout)) {
+      forward(*sub2pair.at(sub_sock));
+    }
+    if (stream_config.enabled) {
+      const uint64_t now = nanos_since_boot();
+      for (auto &[sub_sock, pair] : sub2pair) {
+        flushEncoder(*pair, now);
       }
     }
-    util::sleep_for(1);  // Give zmqMonitorThread a chance to acquire the mutex
+  }
+}
+
+void MsgqToZmq::forward(SocketPair &pair) {
+  auto &c = counters(pair);
+  auto send = [&](Message *msg, bool more) {
+    int ret;
+    while ((ret = pair.pub_sock->sendMessage(msg, more)) == -1) {
+      if (errno != EINTR) break;
+    }
+    if (ret == -1) {
+      c.drops.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      c.msgs.fetch_add(1, std::memory_order_relaxed);
+      c.bytes.fetch_add(msg->getSize(), std::memory_order_relaxed);
+    }
+  };
+
+  if (pair.encoder) {
+    const uint64_t now = nanos_since_boot();
+    for (int i = 0; i < MAX_MESSAGES_PER_SOCKET; ++i) {
+      auto msg = std::unique_ptr<Message>(pair.sub_sock->receive(true));
+      if (!msg) break;
+      if (pair.encoder->add(msg->getData(), msg->getSize(), now)) {
+        c.msgs.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        c.drops.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    return;  // sent by shardThread once the window is full
   }
 
-  thread.join();
+  // hold one message back, so when batching the last one closes the multipart message
+  std::unique_ptr<Message> held;
+  for (int i = 0; i < MAX_MESSAGES_PER_SOCKET; ++i) {
+    auto msg = std::unique_ptr<Message>(pair.sub_sock->receive(true));
+    if (!msg) break;
+
+    if (held) send(held.get(), batch);
+    held = std::move(msg);
+  }
+  if (held) send(held.get(), false);
 }
 
-void MsgqToZmq::zmqMonitorThread() {
-  std::vector<zmq_pollitem_t> pollitems;
+void MsgqToZmq::flushEncoder(SocketPair &pair, uint64_t now_ns) {
+  if (!pair.encoder || !pair.encoder->ready(now_ns)) return;
 
-  // Set up ZMQ monitor for each pub socket
-  for (int i = 0; i < socket_pairs.size(); ++i) {
-    std::string addr = "inproc://op-bridge-monitor-" + std::to_string(i);
-    zmq_socket_monitor(socket_pairs[i].pub_sock->getRawSocket(), addr.c_str(), ZMQ_EVENT_ACCEPTED | ZMQ_EVENT_DISCONNECTED);
+  auto &frame = pair.encoder->flush();
+  // messages were counted as they were added, bytes are what went over the wire
+  auto &c = counters(pair);
+  if (frame.empty()) {
+    // messages were pending, so the frame failed to compress
+    c.drops.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  int ret;
+  while ((ret = pair.pub_sock->send((char *)frame.data(), frame.size())) == -1) {
+    if (errno != EINTR) break;
+  }
+  if (ret == -1) {
+    c.drops.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    c.bytes.fetch_add(frame.size(), std::memory_order_relaxed);
+  }
+}
 
-    void *monitor_socket = zmq_socket(zmq_context->getRawContext(), ZMQ_PAIR);
-    zmq_connect(monitor_socket, addr.c_str());
+void MsgqToZmq::monitorClients(const std::vector<void *> &monitor_sockets) {
+  std::vector<zmq_pollitem_t> pollitems;
+  for (void *monitor_socket : monitor_sockets) {
     pollitems.emplace_back(zmq_pollitem_t{.socket = monitor_socket, .events = ZMQ_POLLIN});
   }
 
+  auto post = [&](SocketPair &pair, bool subscribe) {
+    Shard &shard = *shards[(&pair - socket_pairs.data()) % shards.size()];
+    {
+      std::lock_guard lk(shard.mutex);
+      shard.pending.emplace_back(&pair, subscribe);
+    }
+    shard.cv.notify_one();
+  };
+
   while (!do_exit) {
+    stats->report();
     int ret = zmq_poll(pollitems.data(), pollitems.size(), 1000);
     if (ret < 0) {
       if (errno == EINTR) {
@@ -102,45 +247,19 @@ void MsgqToZmq::zmqMonitorThread() {
         frame = recv_zmq_msg(pollitems[i].socket);
         if (frame.empty()) continue;
 
-        std::unique_lock lk(mutex);
         auto &pair = socket_pairs[i];
         if (event_type & ZMQ_EVENT_ACCEPTED) {
           printf("socket [%s] connected\n", pair.endpoint.c_str());
           if (++pair.connected_clients == 1) {
-            // Create new MSGQ subscriber socket and map to ZMQ publisher
-            pair.sub_sock = std::make_unique<MSGQSubSocket>();
-            size_t queue_size = services.at(pair.endpoint).queue_size;
-            pair.sub_sock->connect(msgq_context.get(), pair.endpoint, "127.0.0.1", false, true, queue_size);
-            sub2pub[pair.sub_sock.get()] = pair.pub_sock.get();
-            registerSockets();
+            post(pair, true);
           }
         } else if (event_type & ZMQ_EVENT_DISCONNECTED) {
           printf("socket [%s] disconnected\n", pair.endpoint.c_str());
           if (pair.connected_clients == 0 || --pair.connected_clients == 0) {
-            // Remove MSGQ subscriber socket from mapping and reset it
-            sub2pub.erase(pair.sub_sock.get());
-            pair.sub_sock.reset(nullptr);
-            registerSockets();
+            post(pair, false);
           }
         }
-        cv.notify_one();
       }
     }
   }
-
-  // Clean up monitor sockets
-  for (int i = 0; i < pollitems.size(); ++i) {
-    zmq_socket_monitor(socket_pairs[i].pub_sock->getRawSocket(), nullptr, 0);
-    zmq_close(pollitems[i].socket);
-  }
-  cv.notify_one();
-}
-
-void MsgqToZmq::registerSockets() {
-  msgq_poller = std::make_unique<MSGQPoller>();
-  for (const auto &socket_pair : socket_pairs) {
-    if (socket_pair.sub_sock) {
-      msgq_poller->registerSocket(socket_pair.sub_sock.get());
-    }
-  }
 }
@@ -1,13 +1,16 @@
 #pragma once
 
 #include <condition_variable>
-#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "msgq/impl_msgq.h"
+#include "openpilot/cereal/messaging/bridge_stats.h"
+#include "openpilot/cereal/messaging/bridge_stream.h"
 #include "openpilot/cereal/messaging/bridge_zmq.h"
 
 class MsgqToZmq {
@@ -16,21 +19,35 @@ public:
   void run(const std::vector<std::string> &endpoints, const std::string &ip);
 
 protected:
-  void registerSockets();
-  void zmqMonitorThread();
-
   struct SocketPair {
     std::string endpoint;
     std::unique_ptr<BridgeZmqPubSocket> pub_sock;
-    std::unique_ptr<MSGQSubSocket> sub_sock;
-    int connected_clients = 0;
+    std::unique_ptr<MSGQSubSocket> sub_sock;  // only touched by the shard thread
+    std::unique_ptr<BridgeStreamEncoder> encoder;  // only with BRIDGE_COMPRESS, owned like sub_sock
+    int connected_clients = 0;                // only touched by monitorClients
+  };
+
+  // forwards a fixed subset of the endpoints on its own thread. the msgq side of an endpoint is
+  // subscribed only while a ZMQ client is connected, requested by monitorClients through pending.
+  struct Shard {
+    std::vector<SocketPair *> pairs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::pair<SocketPair *, bool>> pending;  // (pair, subscribe)
+    std::thread thread;
   };
 
+  void shardThread(Shard &shard);
+  void monitorClients(const std::vector<void *> &monitor_sockets);
+  void forward(SocketPair &pair);
+  void flushEncoder(SocketPair &pair, uint64_t now_ns);
+  BridgeStats::Counters &counters(SocketPair &pair) { return (*stats)[&pair - socket_pairs.data()]; }
+
   std::unique_ptr<Context> msgq_context;
   std::unique_ptr<BridgeZmqContext> zmq_context;
-  std::mutex mutex;
-  std::condition_variable cv;
-  std::unique_ptr<MSGQPoller> msgq_poller;
-  std::map<SubSocket *, BridgeZmqPubSocket *> sub2pub;
   std::vector<SocketPair> socket_pairs;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::unique_ptr<BridgeStats> stats;
+  bool batch = false;
+  BridgeStreamConfig stream_config;
 };
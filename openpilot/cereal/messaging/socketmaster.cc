@@ -1,7 +1,11 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <memory>
 #include <string>
 #include <mutex>
+#include <stdexcept>
+
+#include <capnp/schema.h>
 
 #include "openpilot/cereal/services.h"
 #include "openpilot/cereal/messaging/messaging.h"
@@ -30,22 +34,26 @@ private:
 
 MessageContext message_context;
 
-struct SubMaster::SubMessage {
-  std::string name;
-  SubSocket *socket = nullptr;
-  float freq = 0.0f;
-  bool updated = false, alive = false, valid = false, ignore_alive;
-  uint64_t rcv_time = 0, rcv_frame = 0;
-  void *allocated_msg_reader = nullptr;
-  bool is_polled = false;
-  capnp::FlatArrayMessageReader *msg_reader = nullptr;
-  AlignedBuffer aligned_buf;
-  cereal::Event::Reader event;
-};
+// msgq hands out word aligned heap buffers, so the reader can usually point straight at the
+// received message and keep it alive until the next one. anything else is copied as before.
+kj::ArrayPtr<const capnp::word> SubMaster::SubMessage::attach(Message *received) {
+  const char *data = received->getData();
+  const size_t size = received->getSize();
+  if (reinterpret_cast<uintptr_t>(data) % alignof(capnp::word) == 0 && size % sizeof(capnp::word) == 0) {
+    msg.reset(received);
+    return kj::arrayPtr(reinterpret_cast<const capnp::word *>(data), size / sizeof(capnp::word));
+  }
+
+  msg.reset();
+  auto words = aligned_buf.align(received);
+  delete received;
+  return words;
+}
 
 SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll,
                      const char *address, const std::vector<const char *> &ignore_alive) {
   poller_ = Poller::create();
+  messages_.reserve(service_list.size());
   for (auto name : service_list) {
     assert(services.count(std::string(name)) > 0);
 
@@ -54,50 +62,54 @@ SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::v
     assert(socket != 0);
     bool is_polled = inList(poll, name) || poll.empty();
     if (is_polled) poller_->registerSocket(socket);
-    SubMessage *m = new SubMessage{
+    SubMessage &m = messages_.emplace_back(SubMessage{
       .name = name,
       .socket = socket,
       .freq = serv.frequency,
       .ignore_alive = inList(ignore_alive, name),
       .allocated_msg_reader = malloc(sizeof(capnp::FlatArrayMessageReader)),
-      .is_polled = is_polled};
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader({});
-    messages_[socket] = m;
-    services_[name] = m;
+      .is_polled = is_polled});
+    m.msg_reader = new (m.allocated_msg_reader) capnp::FlatArrayMessageReader({});
+    sockets_[socket] = messages_.size() - 1;
+    services_[name] = messages_.size() - 1;
   }
 }
 
+SubMaster::Handle SubMaster::handle(const char *name) const {
+  auto it = services_.find(name);
+  if (it == services_.end()) {
+    throw std::out_of_range(std::string("SubMaster: unknown service ") + name);
+  }
+  return {it->second};
+}
+
 void SubMaster::update(int timeout) {
-  for (auto &kv : messages_) kv.second->updated = false;
+  for (auto &m : messages_) m.updated = false;
 
   auto sockets = poller_->poll(timeout);
 
   // add non-polled sockets for non-blocking receive
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    SubSocket *s = kv.first;
-    if (!m->is_polled) sockets.push_back(s);
+  for (auto &m : messages_) {
+    if (!m.is_polled) sockets.push_back(m.socket);
   }
 
   uint64_t current_time = nanos_since_boot();
-
-  std::vector<std::pair<std::string, cereal::Event::Reader>> messages;
+  if (++frame == UINT64_MAX) frame = 1;
 
   for (auto s : sockets) {
     Message *msg = s->receive(true);
     if (msg == nullptr) continue;
 
-    SubMessage *m = messages_.at(s);
+    SubMessage &m = messages_[sockets_.at(s)];
 
-    m->msg_reader->~FlatArrayMessageReader();
+    m.msg_reader->~FlatArrayMessageReader();
     capnp::ReaderOptions options;
     options.traversalLimitInWords = kj::maxValue; // Don't limit
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(m->aligned_buf.align(msg), options);
-    delete msg;
-    messages.push_back({m->name, m->msg_reader->getRoot<cereal::Event>()});
+    m.msg_reader = new (m.allocated_msg_reader) capnp::FlatArrayMessageReader(m.attach(msg), options);
+    set_event_(m, m.msg_reader->getRoot<cereal::Event>(), current_time);
   }
 
-  update_msgs(current_time, messages);
+  update_alive_(current_time);
 }
 
 void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages){
@@ -108,29 +120,34 @@ void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<s
     if (m_find == services_.end()){
       continue;
     }
-    SubMessage *m = m_find->second;
-    m->event = kv.second;
-    m->updated = true;
-    m->rcv_time = current_time;
-    m->rcv_frame = frame;
-    m->valid = m->event.getValid();
-    if (SIMULATION) m->alive = true;
+    set_event_(messages_[m_find->second], kv.second, current_time);
   }
 
-  if (!SIMULATION) {
-    for (auto &kv : messages_) {
-      SubMessage *m = kv.second;
-      m->alive = (m->freq <= (1e-5) || ((current_time - m->rcv_time) * (1e-9)) < (10.0 / m->freq));
-    }
+  update_alive_(current_time);
+}
+
+void SubMaster::set_event_(SubMessage &m, const cereal::Event::Reader &event, uint64_t current_time) {
+  m.event = event;
+  m.updated = true;
+  m.rcv_time = current_time;
+  m.rcv_frame = frame;
+  m.valid = m.event.getValid();
+  if (SIMULATION) m.alive = true;
+}
+
+void SubMaster::update_alive_(uint64_t current_time) {
+  if (SIMULATION) return;
+
+  for (auto &m : messages_) {
+    m.alive = (m.freq <= (1e-5) || ((current_time - m.rcv_time) * (1e-9)) < (10.0 / m.freq));
   }
 }
 
 bool SubMaster::all_(const std::vector<const char *> &service_list, bool valid, bool alive) {
   int found = 0;
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    if (service_list.size() == 0 || inList(service_list, m->name.c_str())) {
-      found += (!valid || m->valid) && (!alive || (m->alive || m->ignore_alive));
+  for (auto &m : messages_) {
+    if (service_list.size() == 0 || inList(service_list, m.name.c_str())) {
+      found += (!valid || m.valid) && (!alive || (m.alive || m.ignore_alive));
     }
   }
   return service_list.size() == 0 ? found == messages_.size() : found == service_list.size();
@@ -149,56 +166,50 @@ void SubMaster::drain() {
   }
 }
 
-bool SubMaster::updated(const char *name) const {
-  return services_.at(name)->updated;
-}
-
-bool SubMaster::alive(const char *name) const {
-  return services_.at(name)->alive;
-}
-
-bool SubMaster::valid(const char *name) const {
-  return services_.at(name)->valid;
-}
-
-uint64_t SubMaster::rcv_frame(const char *name) const {
-  return services_.at(name)->rcv_frame;
-}
-
-uint64_t SubMaster::rcv_time(const char *name) const {
-  return services_.at(name)->rcv_time;
-}
-
-cereal::Event::Reader &SubMaster::operator[](const char *name) const {
-  return services_.at(name)->event;
-}
-
 SubMaster::~SubMaster() {
   delete poller_;
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    m->msg_reader->~FlatArrayMessageReader();
-    free(m->allocated_msg_reader);
-    delete m->socket;
-    delete m;
+  for (auto &m : messages_) {
+    m.msg_reader->~FlatArrayMessageReader();
+    free(m.allocated_msg_reader);
+    delete m.socket;
   }
 }
 
 PubMaster::PubMaster(const std::vector<const char *> &service_list) {
+  auto event_schema = capnp::Schema::from<cereal::Event>().asStruct();
+  which_.resize(event_schema.getUnionFields().size(), NOT_PUBLISHED);
+
   for (auto name : service_list) {
     assert(services.count(name) > 0);
     service serv = services.at(std::string(name));
     PubSocket *socket = PubSocket::create(message_context.context(), name, true, serv.queue_size);
     assert(socket);
-    sockets_[name] = socket;
+    sockets_.push_back(socket);
+    services_[name] = sockets_.size() - 1;
+    which_[event_schema.getFieldByName(name).getProto().getDiscriminantValue()] = sockets_.size() - 1;
+  }
+}
+
+PubMaster::Handle PubMaster::handle(const char *name) const {
+  auto it = services_.find(name);
+  if (it == services_.end()) {
+    throw std::out_of_range(std::string("PubMaster: unknown service ") + name);
+  }
+  return {it->second};
+}
+
+PubMaster::Handle PubMaster::handle(cereal::Event::Which which) const {
+  if (which >= which_.size() || which_[which] == NOT_PUBLISHED) {
+    throw std::out_of_range("PubMaster: service " + std::to_string((int)which) + " not published");
   }
+  return {which_[which]};
 }
 
-int PubMaster::send(const char *name, MessageBuilder &msg) {
+int PubMaster::send(Handle h, MessageBuilder &msg) {
   auto bytes = msg.toBytes();
-  return send(name, bytes.begin(), bytes.size());
+  return send(h, bytes.begin(), bytes.size());
 }
 
 PubMaster::~PubMaster() {
-  for (auto s : sockets_) delete s.second;
+  for (auto s : sockets_) delete s;
 }
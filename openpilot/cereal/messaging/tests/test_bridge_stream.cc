@@ -0,0 +1,138 @@
+#include <zdict.h>
+
+#include <string>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "openpilot/cereal/messaging/bridge_stream.h"
+
+const std::string SERVICE = "carState";
+
+static std::vector<std::string> decode(BridgeStreamDecoder &decoder, const std::vector<char> &frame, bool *ok) {
+  std::vector<std::string> messages;
+  *ok = decoder.decode(frame.data(), frame.size(), [&](char *data, size_t size) { messages.emplace_back(data, size); });
+  return messages;
+}
+
+static std::string message(int i) {
+  return "message " + std::to_string(i) + " " + std::string(i % 50, 'a' + i % 26);
+}
+
+// a small dictionary trained on messages like the ones sent, so frames carry its id
+static std::string train_dict(int seed) {
+  std::string samples;
+  std::vector<size_t> sizes;
+  for (int i = 0; i < 2000; ++i) {
+    std::string sample = message(i * seed) + std::to_string(i * i * seed);
+    samples += sample;
+    sizes.push_back(sample.size());
+  }
+  std::string dict(4096, '\0');
+  size_t size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sizes.data(), sizes.size());
+  REQUIRE(!ZDICT_isError(size));
+  dict.resize(size);
+  return dict;
+}
+
+void test_round_trip() {
+  BridgeStreamConfig config;
+  config.enabled = true;
+  BridgeStreamEncoder encoder(config, SERVICE);
+  BridgeStreamDecoder decoder(config);
+
+  CHECK(encoder.flush().empty());
+
+  std::vector<std::string> sent;
+  for (int i = 0; i < 100; ++i) {
+    sent.push_back(message(i));
+    REQUIRE(encoder.add(sent.back().data(), sent.back().size(), i * 1000000ULL));
+  }
+  sent.push_back("");
+  REQUIRE(encoder.add("", 0, 100 * 1000000ULL));
+  CHECK(encoder.ready(100 * 1000000ULL) && !encoder.ready(40 * 1000000ULL));
+
+  bool ok;
+  CHECK(decode(decoder, encoder.flush(), &ok) == sent);
+  CHECK(ok);
+  CHECK(encoder.flush().empty());
+}
+
+// 100 Hz in, 10 Hz out, still 10 Hz with some jitter on the input
+void test_rate_limit() {
+  BridgeStreamConfig config;
+  config.enabled = true;
+  config.rate_limits[SERVICE] = 10;
+  BridgeStreamEncoder encoder(config, SERVICE);
+  BridgeStreamEncoder unlimited(config, "can");
+  BridgeStreamDecoder decoder(config);
+
+  std::vector<std::string> sent;
+  for (int i = 0; i < 1000; ++i) {
+    const uint64_t now_ns = i * 10000000ULL + (i % 3) * 2000000ULL;
+    if (encoder.add(message(i).data(), message(i).size(), now_ns)) sent.push_back(message(i));
+    REQUIRE(unlimited.add(message(i).data(), message(i).size(), now_ns));
+  }
+  CHECK(sent.size() >= 99 && sent.size() <= 101);
+  CHECK(encoder.dropped() == 1000 - sent.size());
+  CHECK(unlimited.dropped() == 0);
+
+  bool ok;
+  CHECK(decode(decoder, encoder.flush(), &ok) == sent);
+  CHECK(ok);
+}
+
+void test_dictionary_mismatch() {
+  BridgeStreamConfig plain, with_dict, other_dict;
+  plain.enabled = with_dict.enabled = other_dict.enabled = true;
+  with_dict.dict = train_dict(1);
+  other_dict.dict = train_dict(7);
+
+  BridgeStreamEncoder encoder(with_dict, SERVICE);
+  BridgeStreamEncoder plain_encoder(plain, SERVICE);
+  for (int i = 0; i < 10; ++i) {
+    REQUIRE(encoder.add(message(i).data(), message(i).size(), 0));
+    REQUIRE(plain_encoder.add(message(i).data(), message(i).size(), 0));
+  }
+  const std::vector<char> frame = encoder.flush(), plain_frame = plain_encoder.flush();
+
+  bool ok;
+  BridgeStreamDecoder same(with_dict), other(other_dict), none(plain);
+  CHECK(decode(same, frame, &ok).size() == 10 && ok);
+  CHECK(decode(other, frame, &ok).empty() && !ok);
+  CHECK(decode(none, frame, &ok).empty() && !ok);
+  CHECK(decode(same, plain_frame, &ok).empty() && !ok);
+}
+
+// nothing is handed out from a frame that is cut short or damaged anywhere
+void test_malformed_frames() {
+  BridgeStreamConfig config;
+  config.enabled = true;
+  BridgeStreamEncoder encoder(config, SERVICE);
+  BridgeStreamDecoder decoder(config);
+  for (int i = 0; i < 20; ++i) {
+    REQUIRE(encoder.add(message(i).data(), message(i).size(), 0));
+  }
+  const std::vector<char> frame = encoder.flush();
+
+  bool ok;
+  for (size_t size = 0; size < frame.size(); ++size) {
+    CHECK(decode(decoder, std::vector<char>(frame.begin(), frame.begin() + size), &ok).empty() && !ok);
+  }
+  for (size_t i = 0; i < frame.size(); ++i) {
+    std::vector<char> corrupted = frame;
+    corrupted[i] ^= 0x55;
+    CHECK(decode(decoder, corrupted, &ok).empty() && !ok);
+  }
+
+  // and the decoder still works afterwards
+  CHECK(decode(decoder, frame, &ok).size() == 20 && ok);
+}
+
+int main() {
+  return run_native_test([] {
+    test_round_trip();
+    test_rate_limit();
+    test_dictionary_mismatch();
+    test_malformed_frames();
+  });
+}
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "openpilot/cereal/messaging/bridge_whitelist.h"
+#include "openpilot/cereal/services.h"
+
+static bool contains(const std::vector<std::string> &list, const std::string &name) {
+  return std::find(list.begin(), list.end(), name) != list.end();
+}
+
+void test_bridge_whitelist() {
+  // msgq -> zmq forwards everything
+  CHECK(get_services("", false).size() == services.size());
+
+  // an exact name matches only itself, not the services it is a substring of
+  auto exact = get_services("can", true);
+  CHECK(exact == std::vector<std::string>{"can"});
+
+  auto mixed = get_services("can, car* /^(sendcan|pandaStates)$/", true);
+  for (auto name : {"can", "sendcan", "pandaStates", "carState", "carControl", "carOutput", "carParams"}) {
+    CHECK(contains(mixed, name));
+  }
+  for (const auto &name : mixed) {
+    CHECK(name == "can" || name == "sendcan" || name == "pandaStates" || name.rfind("car", 0) == 0);
+  }
+
+  // an entry that matches nothing is reported, not fatal
+  CHECK(get_services("notAService", true).empty());
+}
+
+int main() {
+  return run_native_test(test_bridge_whitelist);
+}
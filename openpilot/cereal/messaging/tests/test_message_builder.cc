@@ -0,0 +1,102 @@
+#include <string>
+
+#include "common/tests/native_test.h"
+#include "openpilot/cereal/messaging/messaging.h"
+
+const uint64_t MONO_TIME = 123456789;
+
+static std::string to_string(kj::ArrayPtr<capnp::byte> bytes) {
+  return std::string((const char *)bytes.begin(), bytes.size());
+}
+
+static void init_sentinel(MessageBuilder &msg, int signal) {
+  auto event = msg.initEvent();
+  event.setLogMonoTime(MONO_TIME);
+  auto sentinel = event.initSentinel();
+  sentinel.setType(cereal::Sentinel::SentinelType::END_OF_SEGMENT);
+  sentinel.setSignal(signal);
+}
+
+// reads serialized bytes back the way a subscriber does
+static void check_sentinel(const std::string &bytes, int signal) {
+  AlignedBuffer buf;
+  capnp::FlatArrayMessageReader reader(buf.align(bytes.data(), bytes.size()));
+  auto event = reader.getRoot<cereal::Event>();
+  CHECK(event.getLogMonoTime() == MONO_TIME && event.getValid());
+  REQUIRE(event.which() == cereal::Event::SENTINEL);
+  CHECK(event.getSentinel().getType() == cereal::Sentinel::SentinelType::END_OF_SEGMENT);
+  CHECK(event.getSentinel().getSignal() == signal);
+}
+
+void test_message_builder() {
+  // builders one after another share the thread's arena, each starting from a clean segment
+  const capnp::byte *arena_output;
+  std::string first;
+  {
+    MessageBuilder msg;
+    init_sentinel(msg, 1);
+    auto bytes = msg.toBytes();
+    arena_output = bytes.begin();
+    first = to_string(bytes);
+  }
+  {
+    MessageBuilder msg;
+    init_sentinel(msg, 1);
+    auto bytes = msg.toBytes();
+    CHECK(bytes.begin() == arena_output);
+    CHECK(to_string(bytes) == first);
+  }
+  check_sentinel(first, 1);
+
+  // a builder created while another one holds the arena uses the heap, and leaves the outer one's bytes alone
+  {
+    MessageBuilder outer;
+    init_sentinel(outer, 2);
+    auto outer_bytes = outer.toBytes();
+    const std::string outer_copy = to_string(outer_bytes);
+    {
+      MessageBuilder inner;
+      init_sentinel(inner, 3);
+      auto inner_bytes = inner.toBytes();
+      CHECK(inner_bytes.begin() != arena_output);
+      check_sentinel(to_string(inner_bytes), 3);
+    }
+    CHECK(outer_bytes.begin() == arena_output);
+    CHECK(to_string(outer_bytes) == outer_copy);
+    check_sentinel(outer_copy, 2);
+  }
+
+  // a message bigger than the arena's limit is serialized to the heap
+  {
+    const size_t size = MessageArena::MAX_WORDS * sizeof(capnp::word) * 2;
+    MessageBuilder msg;
+    auto data = msg.initEvent().initWideRoadEncodeData().initData(size);
+    for (size_t i = 0; i < size; ++i) data[i] = i & 0xff;
+    auto bytes = msg.toBytes();
+    CHECK(bytes.begin() != arena_output);
+    CHECK(bytes.size() == msg.getSerializedSize());
+
+    AlignedBuffer buf;
+    capnp::ReaderOptions options;
+    options.traversalLimitInWords = bytes.size();
+    capnp::FlatArrayMessageReader reader(buf.align((const char *)bytes.begin(), bytes.size()), options);
+    auto read_data = reader.getRoot<cereal::Event>().getWideRoadEncodeData().getData();
+    REQUIRE(read_data.size() == size);
+    bool same = true;
+    for (size_t i = 0; i < size; ++i) same &= read_data[i] == (i & 0xff);
+    CHECK(same);
+  }
+
+  // and the arena is still there for the next one
+  {
+    MessageBuilder msg;
+    init_sentinel(msg, 4);
+    auto bytes = msg.toBytes();
+    CHECK(bytes.begin() == arena_output);
+    check_sentinel(to_string(bytes), 4);
+  }
+}
+
+int main() {
+  return run_native_test(test_message_builder);
+}
@@ -0,0 +1,66 @@
+#include <stdexcept>
+#include <string>
+
+#include "common/tests/native_test.h"
+#include "openpilot/cereal/messaging/messaging.h"
+
+template <typename Function>
+static bool throws_out_of_range(Function &&function) {
+  try {
+    function();
+  } catch (const std::out_of_range &) {
+    return true;
+  }
+  return false;
+}
+
+// updates until something arrives
+static void update(SubMaster &sm) {
+  for (int i = 0; i < 10; ++i) {
+    sm.update(100);
+    if (sm.updated("deviceState") || sm.updated("logMessage")) return;
+  }
+  REQUIRE(false);
+}
+
+void test_socketmaster() {
+  SubMaster sm({"deviceState", "logMessage"});
+  PubMaster pm({"logMessage", "deviceState"});
+
+  // handles resolve to the same entries as names, unknown services throw
+  const auto device_state = sm.handle("deviceState"), log_message = sm.handle("logMessage");
+  CHECK(device_state.index != log_message.index);
+  CHECK(throws_out_of_range([&] { sm.handle("carState"); }));
+  CHECK(throws_out_of_range([&] { sm.updated("unknownService"); }));
+
+  // an event type maps to the socket of the service with that name
+  CHECK(pm.handle(cereal::Event::LOG_MESSAGE).index == pm.handle("logMessage").index);
+  CHECK(pm.handle(cereal::Event::DEVICE_STATE).index == pm.handle("deviceState").index);
+  CHECK(throws_out_of_range([&] { pm.handle(cereal::Event::CAR_STATE); }));
+  CHECK(throws_out_of_range([&] { pm.handle("carState"); }));
+
+  {
+    MessageBuilder msg;
+    msg.initEvent().setLogMessage("by event type");
+    REQUIRE(pm.send(cereal::Event::LOG_MESSAGE, msg) > 0);
+  }
+  update(sm);
+  CHECK(sm.updated(log_message) && !sm.updated(device_state));
+  CHECK(sm.rcv_frame(log_message) == sm.frame && sm.rcv_frame(device_state) == 0);
+  CHECK(sm[log_message].getLogMessage() == "by event type");
+  CHECK(sm["logMessage"].getLogMessage() == "by event type");
+
+  {
+    MessageBuilder msg;
+    msg.initEvent().initDeviceState().setFreeSpacePercent(42);
+    REQUIRE(pm.send(pm.handle("deviceState"), msg) > 0);
+  }
+  update(sm);
+  CHECK(sm.updated(device_state) && !sm.updated(log_message));
+  CHECK(sm[device_state].getDeviceState().getFreeSpacePercent() == 42);
+  CHECK(sm.rcv_time(device_state) > sm.rcv_time(log_message));
+}
+
+int main() {
+  return run_native_test(test_socketmaster);
+}
@@ -1,11 +1,18 @@
 #include "common/params.h"
 
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/file.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include <algorithm>
 #include <cassert>
 #include <csignal>
+#include <cstring>
+#include <mutex>
 #include <unordered_map>
 
 #include "common/params_keys.h"
@@ -88,6 +95,123 @@ private:
   int fd_ = -1;
 };
 
+// process-wide cache of param values, so repeated gets don't open and read a file every time.
+// one inotify instance watches every params directory in use. pending events are drained before
+// each lookup, so a value written by any process before get() is never served stale, at the cost
+// of a single non-blocking read instead of open/read/close.
+class ParamsCache {
+public:
+  static ParamsCache &instance() {
+    static ParamsCache cache;
+    return cache;
+  }
+
+  std::string get(const std::string &dir, const std::string &key) {
+    std::lock_guard lk(lock);
+    Dir *d = watch(dir);
+    if (!d) return util::read_file(dir + "/" + key);
+
+    auto it = d->values.find(key);
+    if (it == d->values.end()) {
+      it = d->values.emplace(key, util::read_file(dir + "/" + key)).first;
+    }
+    return it->second;
+  }
+
+  // sleep until something changed in one of the watched directories, or timeout
+  void wait(int timeout_ms) {
+    if (fd < 0) {
+      util::sleep_for(timeout_ms);
+      return;
+    }
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    poll(&pfd, 1, timeout_ms);
+  }
+
+private:
+  struct Dir {
+    int wd;
+    std::unordered_map<std::string, std::string> values;  // "" for missing params
+  };
+
+  ParamsCache() {
+    init();
+    // a forked child must not share the inotify instance with its parent, events would only reach one of them
+    pthread_atfork([] { instance().lock.lock(); },
+                   [] { instance().lock.unlock(); },
+                   [] { ParamsCache &c = instance(); c.reset(); c.lock.unlock(); });
+  }
+
+  void init() {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+      LOGW("params cache disabled, inotify_init1 failed: %s", strerror(errno));
+    }
+#endif
+  }
+
+  void reset() {
+    if (fd >= 0) close(fd);
+    dirs.clear();
+    wd_dirs.clear();
+    init();
+  }
+
+  Dir *watch(const std::string &dir) {
+#ifdef __linux__
+    if (fd < 0) return nullptr;
+    drain();
+
+    if (auto it = dirs.find(dir); it != dirs.end()) {
+      return &it->second;
+    }
+    int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE);
+    if (wd < 0) return nullptr;
+    // the same directory may be reached through different paths
+    if (auto it = wd_dirs.find(wd); it != wd_dirs.end()) {
+      dirs.erase(it->second);
+    }
+    wd_dirs[wd] = dir;
+    return &(dirs[dir] = Dir{.wd = wd});
+#else
+    return nullptr;
+#endif
+  }
+
+#ifdef __linux__
+  void drain() {
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len;) {
+        auto *event = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          for (auto &[path, d] : dirs) d.values.clear();
+          continue;
+        }
+        auto it = wd_dirs.find(event->wd);
+        if (it == wd_dirs.end()) continue;
+        if (event->mask & IN_IGNORED) {
+          // directory removed, watch it again on next use
+          dirs.erase(it->second);
+          wd_dirs.erase(it);
+        } else if (event->len > 0) {
+          dirs[it->second].values.erase(event->name);
+        }
+      }
+    }
+  }
+#endif
+
+  std::mutex lock;
+  int fd = -1;
+  std::unordered_map<std::string, Dir> dirs;
+  std::unordered_map<int, std::string> wd_dirs;
+};
+
 } // namespace
 
 
@@ -176,8 +300,9 @@ int Params::remove(const std::string &key) {
 }
 
 std::string Params::get(const std::string &key, bool block) {
+  ParamsCache &cache = ParamsCache::instance();
   if (!block) {
-    return util::read_file(getParamPath(key));
+    return cache.get(getParamPath(), key);
   } else {
     // blocking read until successful
     params_do_exit = 0;
@@ -186,10 +311,11 @@ std::string Params::get(const std::string &key, bool block) {
 
     std::string value;
     while (!params_do_exit) {
-      if (value = util::read_file(getParamPath(key)); !value.empty()) {
+      if (value = cache.get(getParamPath(), key); !value.empty()) {
         break;
       }
-      util::sleep_for(100);  // 0.1 s
+      // wakes up on any params change, the timeout is only for checking params_do_exit
+      cache.wait(100);
     }
 
     std::signal(SIGINT, prev_handler_sigint);
@@ -233,10 +359,22 @@ void Params::putNonBlocking(const std::string &key, const std::string &val) {
 }
 
 void Params::asyncWriteThread() {
-  // TODO: write the latest one if a key has multiple values in the queue.
   std::pair<std::string, std::string> p;
   while (queue.try_pop(p, 0)) {
-    // Params::put is Thread-Safe
-    put(p.first, p.second);
+    // coalesce everything queued so far, only the latest value of each key is written, at the
+    // position of its latest put so keys still change in the order they were put
+    std::vector<std::pair<std::string, std::string>> batch = {p};
+    while (queue.try_pop(p, 0)) {
+      auto it = std::find_if(batch.begin(), batch.end(), [&](auto &b) { return b.first == p.first; });
+      if (it != batch.end()) {
+        batch.erase(it);
+      }
+      batch.push_back(std::move(p));
+    }
+
+    for (auto &[key, val] : batch) {
+      // Params::put is Thread-Safe
+      put(key, val);
+    }
   }
 }
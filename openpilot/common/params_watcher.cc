@@ -0,0 +1,138 @@
+#include "common/params_watcher.h"
+
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#include <cassert>
+#include <climits>
+#include <cstring>
+
+#include "common/params.h"
+#include "common/swaglog.h"
+#include "common/util.h"
+
+ParamsWatcher::ParamsWatcher(const std::vector<std::string> &keys, Callback callback, const std::string &path)
+    : callback_(callback) {
+  params_dir_ = Params(path).getParamPath();
+  for (auto &key : keys) {
+    values_[key] = "";
+  }
+
+#ifdef __linux__
+  // watch before the initial read, so no change can slip in between
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (inotify_fd_ < 0 || wakeup_fd_ < 0 ||
+      inotify_add_watch(inotify_fd_, params_dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+    // e.g. fs.inotify.max_user_instances used up
+    LOGW("failed to watch %s, polling instead: %s", params_dir_.c_str(), strerror(errno));
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+    if (wakeup_fd_ >= 0) close(wakeup_fd_);
+    inotify_fd_ = wakeup_fd_ = -1;
+  }
+#endif
+
+  for (auto &[key, value] : values_) {
+    value = util::read_file(params_dir_ + "/" + key);
+  }
+  thread_ = std::thread(&ParamsWatcher::watchThread, this);
+}
+
+ParamsWatcher::~ParamsWatcher() {
+  {
+    // under the lock, so the polling loop can't miss it between its check and its wait
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+#ifdef __linux__
+  if (wakeup_fd_ >= 0) {
+    uint64_t one = 1;
+    HANDLE_EINTR(write(wakeup_fd_, &one, sizeof(one)));
+  }
+#endif
+  cv_.notify_all();
+  thread_.join();
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+  if (wakeup_fd_ >= 0) close(wakeup_fd_);
+}
+
+std::string ParamsWatcher::get(const std::string &key) const {
+  std::lock_guard lk(lock_);
+  auto it = values_.find(key);
+  assert(it != values_.end());
+  return it->second;
+}
+
+bool ParamsWatcher::waitForChange(uint64_t last_version, int timeout_ms) const {
+  std::unique_lock lk(lock_);
+  return cv_.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&] { return exit_ || version() != last_version; }) &&
+         version() != last_version;
+}
+
+void ParamsWatcher::refresh(const std::string &key) {
+  std::string value = util::read_file(params_dir_ + "/" + key);
+  {
+    std::lock_guard lk(lock_);
+    std::string &cur = values_.at(key);
+    if (cur == value) return;
+    cur = value;
+    version_.fetch_add(1, std::memory_order_release);
+  }
+  cv_.notify_all();
+  if (callback_) callback_(key, value);
+}
+
+void ParamsWatcher::watchThread() {
+  util::set_thread_name("params_watcher");
+
+  // report the initial values
+  if (callback_) {
+    std::map<std::string, std::string> values;
+    {
+      std::lock_guard lk(lock_);
+      values = values_;
+    }
+    for (auto &[key, value] : values) callback_(key, value);
+  }
+
+#ifdef __linux__
+  alignas(struct inotify_event) char buf[4096];
+  while (inotify_fd_ >= 0 && !exit_) {
+    struct pollfd fds[] = {{.fd = inotify_fd_, .events = POLLIN}, {.fd = wakeup_fd_, .events = POLLIN}};
+    if (HANDLE_EINTR(poll(fds, std::size(fds), -1)) < 0) break;
+    if (!(fds[0].revents & POLLIN)) continue;
+
+    ssize_t len;
+    while ((len = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len;) {
+        auto *event = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          // events were lost, any of the files may have changed
+          for (auto &it : values_) {
+            refresh(it.first);
+          }
+        } else if (event->len > 0 && values_.count(event->name)) {
+          refresh(event->name);
+        }
+      }
+    }
+  }
+#endif
+
+  // no inotify, poll the files
+  while (!exit_) {
+    {
+      std::unique_lock lk(lock_);
+      cv_.wait_for(lk, std::chrono::milliseconds(100), [this] { return exit_.load(); });
+    }
+    if (exit_) break;
+    for (auto &it : values_) {
+      refresh(it.first);
+    }
+  }
+}
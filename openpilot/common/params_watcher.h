@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// keeps an in-memory snapshot of a few params, refreshed when their files change (inotify on
+// linux, polling elsewhere). lets hot loops check params without touching the filesystem.
+class ParamsWatcher {
+public:
+  // called on the watcher thread with the new value, "" if the param was removed
+  using Callback = std::function<void(const std::string &key, const std::string &value)>;
+
+  ParamsWatcher(const std::vector<std::string> &keys, Callback callback = nullptr, const std::string &path = {});
+  ~ParamsWatcher();
+
+  std::string get(const std::string &key) const;
+  bool getBool(const std::string &key) const { return get(key) == "1"; }
+  // incremented on every change, cheap to compare against a previously seen value
+  uint64_t version() const { return version_.load(std::memory_order_acquire); }
+  // wait until version() differs from last_version. returns false on timeout
+  bool waitForChange(uint64_t last_version, int timeout_ms) const;
+
+private:
+  void watchThread();
+  void refresh(const std::string &key);
+
+  std::string params_dir_;
+  Callback callback_;
+  std::map<std::string, std::string> values_;
+  mutable std::mutex lock_;
+  mutable std::condition_variable cv_;
+  std::atomic<uint64_t> version_ = 0;
+
+  std::atomic<bool> exit_ = false;
+  int inotify_fd_ = -1;
+  int wakeup_fd_ = -1;
+  std::thread thread_;
+};
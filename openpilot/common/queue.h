@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <queue>
 
@@ -50,3 +55,191 @@ private:
   std::condition_variable cv;
   std::queue<T> q;
 };
+
+// what push() does when a bounded queue is full
+enum class QueueFullPolicy {
+  DropNewest,  // discard the value being pushed
+  DropOldest,  // evict the oldest queued value to make room, for data that's useless once stale
+  Block,       // wait for the consumer to make room, nothing is lost
+};
+
+struct QueueStats {
+  size_t pushed = 0;      // values that made it into the queue
+  size_t dropped = 0;     // values lost to the full policy, either side
+  size_t high_water = 0;  // largest occupancy seen by a producer
+};
+
+// bounded lock-free ring buffer, single consumer, one or many producers. each slot carries a
+// sequence number, so a slot is only reused once its reader is done with it. that also lets a
+// producer evict the oldest value under QueueFullPolicy::DropOldest while the consumer pops.
+// pop() can block, producers only take the wait mutex to wake a sleeping consumer. under
+// QueueFullPolicy::Block push() waits for room the same way, woken by the consumer.
+template <class T, bool MultiProducer>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity, QueueFullPolicy full_policy = QueueFullPolicy::DropNewest)
+      : cap(capacity), policy(full_policy), slots(std::make_unique<Slot[]>(capacity)) {
+    for (size_t i = 0; i < cap; ++i) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // false when the queue is full, v is left untouched
+  bool try_push(T&& v) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots[pos % cap];
+      const intptr_t dif = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+      if (dif < 0) {
+        return false;
+      } else if (dif == 0) {
+        if constexpr (MultiProducer) {
+          if (!tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) continue;
+        } else {
+          tail.store(pos + 1, std::memory_order_relaxed);
+        }
+        slot.value = std::move(v);
+        slot.seq.store(pos + 1, std::memory_order_release);
+        pushed(pos + 1);
+        return true;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // pushes according to the full policy. false if a value was dropped to do so
+  bool push(T v) {
+    if (policy == QueueFullPolicy::Block) {
+      while (!try_push(std::move(v))) {
+        wait(space_m, space_cv, space_waiters, -1, [this] { return size() < cap; });
+      }
+      return true;
+    }
+
+    bool dropped = false;
+    while (!try_push(std::move(v))) {
+      if (policy == QueueFullPolicy::DropNewest) {
+        n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      // a failed pop means the consumer just made room
+      T oldest;
+      if (try_pop(oldest)) {
+        n_dropped.fetch_add(1, std::memory_order_relaxed);
+        dropped = true;
+      }
+    }
+    return !dropped;
+  }
+
+  bool try_pop(T& v) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots[pos % cap];
+      const intptr_t dif = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+      if (dif < 0) {
+        return false;
+      } else if (dif == 0) {
+        // producers evicting under DropOldest race the consumer for the head
+        if (!head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) continue;
+        v = std::move(slot.value);
+        slot.seq.store(pos + cap, std::memory_order_release);
+        if (policy == QueueFullPolicy::Block) notify(space_m, space_cv, space_waiters);
+        return true;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // waits up to timeout_ms for a value, forever if negative
+  bool pop(T& v, int timeout_ms = -1) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    while (!try_pop(v)) {
+      if (!wait(wait_m, wait_cv, waiters, timeout_ms, [this] { return !empty(); }, deadline)) {
+        return try_pop(v);
+      }
+    }
+    return true;
+  }
+
+  // waits up to timeout_ms for a value without taking it, for consumers that pop under their own lock
+  bool wait_nonempty(int timeout_ms) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    return !empty() || wait(wait_m, wait_cv, waiters, timeout_ms, [this] { return !empty(); }, deadline);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t size() const {
+    const size_t h = head.load(std::memory_order_acquire);
+    const size_t t = tail.load(std::memory_order_acquire);
+    return t > h ? std::min(t - h, cap) : 0;
+  }
+
+  size_t capacity() const { return cap; }
+
+  QueueStats stats() const {
+    return {n_pushed.load(std::memory_order_relaxed), n_dropped.load(std::memory_order_relaxed),
+            high_water.load(std::memory_order_relaxed)};
+  }
+
+private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  void pushed(size_t new_tail) {
+    n_pushed.fetch_add(1, std::memory_order_relaxed);
+    const size_t occupancy = std::min(new_tail - std::min(new_tail, head.load(std::memory_order_relaxed)), cap);
+    size_t hw = high_water.load(std::memory_order_relaxed);
+    while (occupancy > hw && !high_water.compare_exchange_weak(hw, occupancy, std::memory_order_relaxed)) {}
+
+    notify(wait_m, wait_cv, waiters);
+  }
+
+  // the predicates only look at head and tail, so no push or pop runs under a wait mutex and the
+  // two sides never hold one mutex while taking the other. a slot that's claimed but not yet
+  // written just sends the caller around once more.
+  template <class Pred>
+  static bool wait(std::mutex &m, std::condition_variable &cv, std::atomic<int> &n_waiters, int timeout_ms, Pred pred,
+                   std::chrono::steady_clock::time_point deadline = {}) {
+    std::unique_lock lk(m);
+    n_waiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ret = true;
+    if (timeout_ms < 0) {
+      cv.wait(lk, pred);
+    } else {
+      ret = cv.wait_until(lk, deadline, pred);
+    }
+    n_waiters.fetch_sub(1, std::memory_order_relaxed);
+    return ret;
+  }
+
+  // pairs with the fence in wait(), so either we see the waiter or it sees the change
+  static void notify(std::mutex &m, std::condition_variable &cv, std::atomic<int> &n_waiters) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (n_waiters.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard lk(m);
+      cv.notify_one();
+    }
+  }
+
+  const size_t cap;
+  const QueueFullPolicy policy;
+  std::unique_ptr<Slot[]> slots;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) std::atomic<size_t> n_pushed{0}, n_dropped{0}, high_water{0};
+  std::atomic<int> waiters{0}, space_waiters{0};
+  std::mutex wait_m, space_m;
+  std::condition_variable wait_cv, space_cv;
+};
+
+template <class T>
+using SPSCQueue = BoundedQueue<T, false>;
+template <class T>
+using MPSCQueue = BoundedQueue<T, true>;
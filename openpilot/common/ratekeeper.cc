@@ -6,18 +6,42 @@
 #include "common/timing.h"
 #include "common/util.h"
 
+void TimingHistogram::add(double ms) {
+  const size_t i = std::upper_bound(BOUNDS_MS.begin(), BOUNDS_MS.end(), ms) - BOUNDS_MS.begin();
+  ++buckets_[i];
+  ++count_;
+  sum_ += ms;
+  max_ = std::max(max_, ms);
+}
+
+double TimingHistogram::percentile(double p) const {
+  if (count_ == 0) return 0;
+
+  const uint64_t rank = std::clamp<uint64_t>(p * count_ + 0.5, 1, count_);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BOUNDS_MS.size(); ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) return std::min(BOUNDS_MS[i], max_);
+  }
+  return max_;
+}
+
 RateKeeper::RateKeeper(const std::string &name_, float rate, float print_delay_threshold_)
     : name(name_),
       print_delay_threshold(std::max(0.f, print_delay_threshold_)) {
   interval = 1 / rate;
   last_monitor_time = seconds_since_boot();
+  last_wake_time = last_publish_time = last_monitor_time;
   next_frame_time = last_monitor_time + interval;
+  publish_interval = std::max(0.f, util::getenv("RATEKEEPER_STATS_INTERVAL", 60.f));
 }
 
 bool RateKeeper::keepTime() {
   bool lagged = monitorTime();
   if (remaining_ > 0) {
     util::sleep_for(remaining_ * 1000);
+    last_wake_time = seconds_since_boot();
+    stats_.jitter.add(std::max(0., last_wake_time - (last_monitor_time + remaining_)) * 1000);
   }
   return lagged;
 }
@@ -26,9 +50,13 @@ bool RateKeeper::monitorTime() {
   ++frame_;
   last_monitor_time = seconds_since_boot();
   remaining_ = next_frame_time - last_monitor_time;
+  stats_.duration.add((last_monitor_time - last_wake_time) * 1000);
+  last_wake_time = last_monitor_time;
 
   bool lagged = remaining_ < 0;
   if (lagged) {
+    ++stats_.overruns;
+    ++total_overruns_;
     if (print_delay_threshold > 0 && remaining_ < -print_delay_threshold) {
       LOGW("%s lagging by %.2f ms", name.c_str(), -remaining_ * 1000);
     }
@@ -36,5 +64,19 @@ bool RateKeeper::monitorTime() {
   } else {
     next_frame_time += interval;
   }
+
+  if (publish_interval > 0 && last_monitor_time - last_publish_time >= publish_interval) {
+    publishStats(last_monitor_time);
+  }
   return lagged;
 }
+
+void RateKeeper::publishStats(double now) {
+  const auto &d = stats_.duration, &j = stats_.jitter;
+  LOG("%s timing: %lu frames, %lu overruns (%lu total), duration ms p50 %.2f p99 %.2f max %.2f mean %.2f, "
+      "jitter ms p50 %.2f p99 %.2f max %.2f",
+      name.c_str(), (unsigned long)d.count(), (unsigned long)stats_.overruns, (unsigned long)total_overruns_,
+      d.percentile(0.5), d.percentile(0.99), d.max(), d.mean(), j.percentile(0.5), j.percentile(0.99), j.max());
+  stats_ = {};
+  last_publish_time = now;
+}
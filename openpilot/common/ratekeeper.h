@@ -1,23 +1,64 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <string>
 
+// fixed bucket histogram of loop timings in ms, cheap enough to update every frame
+class TimingHistogram {
+public:
+  // bucket upper bounds, the last bucket holds everything slower
+  static constexpr std::array<double, 12> BOUNDS_MS = {0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100, 500};
+
+  void add(double ms);
+  void reset() { *this = {}; }
+  // upper bound of the bucket holding the p-th fraction of samples, max() for the last one
+  double percentile(double p) const;
+  uint64_t count() const { return count_; }
+  double mean() const { return count_ ? sum_ / count_ : 0; }
+  double max() const { return max_; }
+  const std::array<uint32_t, BOUNDS_MS.size() + 1> &buckets() const { return buckets_; }
+
+private:
+  std::array<uint32_t, BOUNDS_MS.size() + 1> buckets_ = {};
+  uint64_t count_ = 0;
+  double sum_ = 0;
+  double max_ = 0;
+};
+
 class RateKeeper {
 public:
+  struct Stats {
+    TimingHistogram duration;  // time between consecutive monitorTime calls, minus the sleep in keepTime
+    TimingHistogram jitter;    // how late keepTime woke up after sleeping
+    uint64_t overruns = 0;     // frames that started after their deadline
+  };
+
   RateKeeper(const std::string &name, float rate, float print_delay_threshold = 0);
   ~RateKeeper() {}
   bool keepTime();
   bool monitorTime();
   inline uint64_t frame() const { return frame_; }
   inline double remaining() const { return remaining_; }
+  // since the last periodic publish, which logs and resets them every RATEKEEPER_STATS_INTERVAL
+  // seconds (default 60, 0 disables)
+  inline const Stats &stats() const { return stats_; }
+  inline uint64_t totalOverruns() const { return total_overruns_; }
 
 private:
+  void publishStats(double now);
+
   double interval;
   double next_frame_time;
   double last_monitor_time;
+  double last_wake_time;
   double remaining_ = 0;
   float print_delay_threshold = 0;
   uint64_t frame_ = 0;
   std::string name;
+
+  Stats stats_;
+  uint64_t total_overruns_ = 0;
+  double publish_interval;
+  double last_publish_time;
 };
@@ -4,17 +4,65 @@
 
 #include "common/swaglog.h"
 
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 
+#include <unistd.h>
 #include <zmq.h>
 #include <stdarg.h>
 #include "json11/json11.hpp"
+#include "common/queue.h"
+#include "common/util.h"
 #include "common/version.h"
 #include "common/hardware/hw.h"
 
+namespace {
+
+constexpr size_t LOG_QUEUE_SIZE = 512;
+constexpr int WRITER_WAIT_MS = 100;
+
+// one log call, formatted on the calling thread. filename and func are __FILE__/__func__, which
+// outlive the queue
+struct LogRecord {
+  int levelnum;
+  const char* filename;
+  int lineno;
+  const char* func;
+  double created;
+  bool timestamp;  // cloudlog_t event
+  uint32_t frame_id;
+  uint64_t time_ns;
+  char msg[512];
+  std::string long_msg;  // messages that don't fit msg, rare
+
+  const char* text() const { return long_msg.empty() ? msg : long_msg.c_str(); }
+};
+
+}  // namespace
+
+bool LOG_TIMESTAMPS = getenv("LOG_TIMESTAMPS");
+uint32_t NO_FRAME_ID = std::numeric_limits<uint32_t>::max();
+
+class SwaglogState;
+static std::atomic<SwaglogState*> swaglog_state = nullptr;
+static void (*prev_terminate)() = nullptr;
+
+// Below CLOUDLOG_ERROR, log calls only format into a thread local record and push it into a
+// lock-free ring. A background thread builds the JSON, prints and sends, so those never block a
+// real-time thread. When the ring is full new messages are dropped and counted, the count is
+// logged once there's room again.
+// Errors usually come right before an assert or a crash, so they flush the ring and are sent
+// inline. std::terminate flushes the ring too. Nothing runs on SIGABRT, none of this is
+// async-signal-safe.
 class SwaglogState {
 public:
   SwaglogState() {
@@ -59,83 +107,168 @@ public:
     ctx_j["version"] = COMMA_VERSION;
     ctx_j["dirty"] = !getenv("CLEAN");
     ctx_j["device"] = Hardware::get_name();
+
+    pid = getpid();
+    thread = std::make_unique<std::thread>(&SwaglogState::writerThread, this);
+    installTerminateHandler();
   }
 
   ~SwaglogState() {
+    if (getpid() != pid) {
+      // forked without exec, the writer thread didn't come along
+      thread.release();
+      return;
+    }
+    // flush what's queued before closing the socket
+    swaglog_state = nullptr;
+    do_exit = true;
+    thread->join();
     zmq_close(sock);
     zmq_ctx_destroy(zctx);
   }
 
-  void log(int levelnum, const char* filename, int lineno, const char* func, const char* msg, const std::string& log_s) {
-    std::lock_guard lk(lock);
-    if (levelnum >= print_level) {
-      printf("%s: %s\n", filename, msg);
+  void log(LogRecord&& record) {
+    if (record.levelnum >= CLOUDLOG_ERROR) {
+      std::lock_guard lk(write_lock);
+      drain();
+      write(record);
+    } else {
+      queue.push(std::move(record));
+    }
+  }
+
+  // best effort from a terminating thread, which may itself hold the lock
+  void terminateFlush() {
+    if (getpid() != pid) return;
+    std::unique_lock lk(write_lock, std::try_to_lock);
+    if (lk) drain();
+  }
+
+private:
+  void installTerminateHandler() {
+    swaglog_state = this;
+    prev_terminate = std::set_terminate([] {
+      if (auto s = swaglog_state.load()) s->terminateFlush();
+      if (prev_terminate) prev_terminate();
+      abort();
+    });
+  }
+
+  void writerThread() {
+    util::set_thread_name("swaglog");
+
+    while (!do_exit) {
+      if (queue.wait_nonempty(WRITER_WAIT_MS)) {
+        std::lock_guard lk(write_lock);
+        drain();
+      }
+    }
+    std::lock_guard lk(write_lock);
+    drain();
+  }
+
+  // writes everything queued, holding write_lock
+  void drain() {
+    while (queue.try_pop(drain_record)) {
+      write(drain_record);
+    }
+
+    if (size_t drops = queue.stats().dropped; drops != reported_drops) {
+      LogRecord warning = {.levelnum = CLOUDLOG_WARNING, .filename = __FILE__, .lineno = __LINE__, .func = __func__,
+                           .created = seconds_since_epoch(), .timestamp = false};
+      snprintf(warning.msg, sizeof(warning.msg), "swaglog: %zu messages dropped", drops - reported_drops);
+      write(warning);
+      reported_drops = drops;
+    }
+  }
+
+  void write(const LogRecord& r) {
+    json11::Json::object log_j = json11::Json::object {
+      {"ctx", ctx_j},
+      {"levelnum", r.levelnum},
+      {"filename", r.filename},
+      {"lineno", r.lineno},
+      {"funcname", r.func},
+      {"created", r.created}
+    };
+    if (!r.timestamp) {
+      log_j["msg"] = r.text();
+    } else {
+      json11::Json::object tspt_j = json11::Json::object{
+        {"event", r.text()},
+        {"time", std::to_string(r.time_ns)}
+      };
+      if (r.frame_id < NO_FRAME_ID) {
+        tspt_j["frame_id"] = std::to_string(r.frame_id);
+      }
+      log_j["msg"] = json11::Json::object{{"timestamp", tspt_j}};
+    }
+
+    log_s.clear();
+    log_s += (char)r.levelnum;
+    ((json11::Json)log_j).dump(log_s);
+
+    if (r.levelnum >= print_level) {
+      printf("%s: %s\n", r.filename, r.text());
     }
     zmq_send(sock, log_s.data(), log_s.length(), ZMQ_NOBLOCK);
   }
 
-  std::mutex lock;
   void* zctx = nullptr;
   void* sock = nullptr;
   int print_level;
   json11::Json::object ctx_j;
-};
+  // everything below is only touched under write_lock
+  std::mutex write_lock;
+  std::string log_s;
+  LogRecord drain_record;
+  size_t reported_drops = 0;
 
-bool LOG_TIMESTAMPS = getenv("LOG_TIMESTAMPS");
-uint32_t NO_FRAME_ID = std::numeric_limits<uint32_t>::max();
+  MPSCQueue<LogRecord> queue{LOG_QUEUE_SIZE};
+  std::atomic<bool> do_exit = false;
+  pid_t pid;
+  std::unique_ptr<std::thread> thread;
+};
 
 static void cloudlog_common(int levelnum, const char* filename, int lineno, const char* func,
-                            char* msg_buf, const json11::Json::object &msg_j={}) {
+                            const char* fmt, va_list args, bool timestamp = false, uint32_t frame_id = NO_FRAME_ID) {
   static SwaglogState s;
+  thread_local LogRecord record;
 
-  json11::Json::object log_j = json11::Json::object {
-    {"ctx", s.ctx_j},
-    {"levelnum", levelnum},
-    {"filename", filename},
-    {"lineno", lineno},
-    {"funcname", func},
-    {"created", seconds_since_epoch()}
-  };
-  if (msg_j.empty()) {
-    log_j["msg"] = msg_buf;
-  } else {
-    log_j["msg"] = msg_j;
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int len = vsnprintf(record.msg, sizeof(record.msg), fmt, args);
+  record.long_msg.clear();
+  if (len >= (int)sizeof(record.msg)) {
+    record.long_msg.resize(len);
+    vsnprintf(record.long_msg.data(), len + 1, fmt, args_copy);
   }
+  va_end(args_copy);
+  if (len <= 0) return;
 
-  std::string log_s;
-  log_s += (char)levelnum;
-  ((json11::Json)log_j).dump(log_s);
-  s.log(levelnum, filename, lineno, func, msg_buf, log_s);
-
-  free(msg_buf);
+  record.levelnum = levelnum;
+  record.filename = filename;
+  record.lineno = lineno;
+  record.func = func;
+  record.created = seconds_since_epoch();
+  record.timestamp = timestamp;
+  record.frame_id = frame_id;
+  record.time_ns = timestamp ? nanos_since_boot() : 0;
+  s.log(std::move(record));
 }
 
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  char* msg_buf = nullptr;
-  int ret = vasprintf(&msg_buf, fmt, args);
+  cloudlog_common(levelnum, filename, lineno, func, fmt, args);
   va_end(args);
-  if (ret <= 0 || !msg_buf) return;
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf);
 }
 
 void cloudlog_t_common(int levelnum, const char* filename, int lineno, const char* func,
                        uint32_t frame_id, const char* fmt, va_list args) {
   if (!LOG_TIMESTAMPS) return;
-  char* msg_buf = nullptr;
-  int ret = vasprintf(&msg_buf, fmt, args);
-  if (ret <= 0 || !msg_buf) return;
-  json11::Json::object tspt_j = json11::Json::object{
-    {"event", msg_buf},
-    {"time", std::to_string(nanos_since_boot())}
-  };
-  if (frame_id < NO_FRAME_ID) {
-    tspt_j["frame_id"] = std::to_string(frame_id);
-  }
-  tspt_j = json11::Json::object{{"timestamp", tspt_j}};
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf, tspt_j);
+  cloudlog_common(levelnum, filename, lineno, func, fmt, args, true, frame_id);
 }
 
 
@@ -0,0 +1,99 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "common/params.h"
+#include "common/tests/native_test.h"
+#include "common/util.h"
+
+const std::string BITRATE = "LivestreamEncoderBitrate", KEYFRAME = "LivestreamRequestKeyframe";
+
+// gets are served from the cache, which a write from outside Params has to invalidate
+void test_cache(Params &params) {
+  REQUIRE(params.put(BITRATE, "1000") == 0);
+  CHECK(params.get(BITRATE) == "1000");
+  CHECK(params.get(BITRATE) == "1000");
+  REQUIRE(params.put(BITRATE, "2000") == 0);
+  CHECK(params.get(BITRATE) == "2000");
+
+  // written in place, like another process without Params would
+  const std::string path = params.getParamPath(BITRATE);
+  REQUIRE(util::write_file(path.c_str(), "3000", 4, O_WRONLY | O_TRUNC) == 0);
+  CHECK(params.get(BITRATE) == "3000");
+
+  REQUIRE(params.remove(BITRATE) == 0);
+  CHECK(params.get(BITRATE) == "");
+  REQUIRE(util::write_file(path.c_str(), "4000", 4, O_WRONLY | O_CREAT) == 0);
+  CHECK(params.get(BITRATE) == "4000");
+  REQUIRE(params.remove(BITRATE) == 0);
+}
+
+// a blocking get returns once the value shows up
+void test_blocking_get(Params &params) {
+  auto value = std::async(std::launch::async, [&params]() { return params.get(KEYFRAME, true); });
+  CHECK(value.wait_for(std::chrono::milliseconds(200)) == std::future_status::timeout);
+
+  REQUIRE(params.putBool(KEYFRAME, true) == 0);
+  REQUIRE(value.wait_for(std::chrono::seconds(2)) == std::future_status::ready);
+  CHECK(value.get() == "1");
+  REQUIRE(params.remove(KEYFRAME) == 0);
+}
+
+// coalesced async writes keep the order of the last put of each key
+void test_put_non_blocking(Params &params) {
+  int fd = inotify_init1(IN_CLOEXEC);
+  REQUIRE(fd >= 0);
+  REQUIRE(inotify_add_watch(fd, params.getParamPath().c_str(), IN_MOVED_TO) >= 0);
+
+  for (int run = 0; run < 20; ++run) {
+    params.putNonBlocking(BITRATE, "1");
+    params.putNonBlocking(KEYFRAME, "1");
+    params.putNonBlocking(BITRATE, "2");
+
+    // until both keys have their final value
+    std::vector<std::string> written;
+    while (params.get(BITRATE) != "2" || params.get(KEYFRAME) != "1") {
+      util::sleep_for(1);
+    }
+    alignas(struct inotify_event) char buf[4096];
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (poll(&pfd, 1, 50) > 0) {
+      ssize_t len = read(fd, buf, sizeof(buf));
+      REQUIRE(len > 0);
+      for (char *p = buf; p < buf + len;) {
+        auto *event = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+        written.push_back(event->name);
+      }
+    }
+    REQUIRE(written.size() >= 2);
+    CHECK(written.back() == BITRATE);
+
+    REQUIRE(params.remove(BITRATE) == 0);
+    REQUIRE(params.remove(KEYFRAME) == 0);
+  }
+  close(fd);
+}
+
+void test_params() {
+  char dir_template[] = "/tmp/test_params_XXXXXX";
+  REQUIRE(mkdtemp(dir_template) != nullptr);
+  const std::string dir = dir_template;
+  {
+    Params params(dir);
+    test_cache(params);
+    test_blocking_get(params);
+    test_put_non_blocking(params);
+  }
+  util::check_system(("rm -rf " + dir).c_str());
+}
+
+int main() {
+  return run_native_test(test_params);
+}
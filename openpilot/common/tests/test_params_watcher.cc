@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "common/params.h"
+#include "common/params_watcher.h"
+#include "common/tests/native_test.h"
+#include "common/util.h"
+
+const std::string BITRATE = "LivestreamEncoderBitrate", KEYFRAME = "LivestreamRequestKeyframe";
+
+// waits for the watcher to see the next change, returns the value it ends up with
+static std::string next_value(ParamsWatcher &watcher, uint64_t &version, const std::string &key) {
+  REQUIRE(watcher.waitForChange(version, 2000));
+  version = watcher.version();
+  return watcher.get(key);
+}
+
+void test_params_watcher() {
+  char dir_template[] = "/tmp/test_params_watcher_XXXXXX";
+  REQUIRE(mkdtemp(dir_template) != nullptr);
+  const std::string dir = dir_template;
+
+  Params params(dir);
+  REQUIRE(params.put(BITRATE, "1000") == 0);
+
+  std::mutex lock;
+  std::map<std::string, std::string> seen;
+  ParamsWatcher watcher({BITRATE, KEYFRAME}, [&](const std::string &key, const std::string &value) {
+    std::lock_guard lk(lock);
+    seen[key] = value;
+  }, dir);
+
+  // values from before the watcher started
+  CHECK(watcher.get(BITRATE) == "1000");
+  CHECK(watcher.get(KEYFRAME) == "");
+
+  uint64_t version = watcher.version();
+  REQUIRE(params.put(BITRATE, "2000") == 0);
+  CHECK(next_value(watcher, version, BITRATE) == "2000");
+
+  // a key that didn't exist yet, then removed again
+  REQUIRE(params.putBool(KEYFRAME, true) == 0);
+  CHECK(next_value(watcher, version, KEYFRAME) == "1");
+  REQUIRE(params.remove(KEYFRAME) == 0);
+  CHECK(next_value(watcher, version, KEYFRAME) == "");
+
+  // writing the same value again isn't a change
+  REQUIRE(params.put(BITRATE, "2000") == 0);
+  CHECK(!watcher.waitForChange(version, 200));
+
+  {
+    std::lock_guard lk(lock);
+    CHECK(seen[BITRATE] == "2000" && seen.count(KEYFRAME) && seen[KEYFRAME] == "");
+  }
+
+  params.remove(BITRATE);
+  util::check_system(("rm -rf " + dir).c_str());
+}
+
+int main() {
+  return run_native_test(test_params_watcher);
+}
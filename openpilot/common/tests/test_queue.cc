@@ -0,0 +1,136 @@
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/queue.h"
+#include "common/tests/native_test.h"
+
+void test_policies() {
+  SPSCQueue<std::unique_ptr<int>> q(2);
+  CHECK(q.capacity() == 2);
+  CHECK(q.try_push(std::make_unique<int>(1)));
+  CHECK(q.try_push(std::make_unique<int>(2)));
+
+  // try_push keeps the value when full
+  auto v = std::make_unique<int>(3);
+  CHECK(!q.try_push(std::move(v)));
+  REQUIRE(v && *v == 3);
+
+  // the default policy drops the new value
+  CHECK(!q.push(std::make_unique<int>(4)));
+  CHECK(q.size() == 2);
+
+  std::unique_ptr<int> out;
+  REQUIRE(q.try_pop(out));
+  CHECK(*out == 1);
+  REQUIRE(q.try_pop(out));
+  CHECK(*out == 2);
+  CHECK(q.empty() && !q.try_pop(out));
+
+  auto stats = q.stats();
+  CHECK(stats.pushed == 2 && stats.dropped == 1 && stats.high_water == 2);
+
+  MPSCQueue<int> oldest(3, QueueFullPolicy::DropOldest);
+  for (int i = 0; i < 5; ++i) {
+    CHECK(oldest.push(i) == (i < 3));
+  }
+  for (int expected : {2, 3, 4}) {
+    int i = -1;
+    REQUIRE(oldest.try_pop(i));
+    CHECK(i == expected);
+  }
+  stats = oldest.stats();
+  CHECK(stats.pushed == 5 && stats.dropped == 2 && stats.high_water == 3);
+}
+
+void test_blocking_pop() {
+  SPSCQueue<int> q(4);
+  int v = 0;
+  CHECK(!q.pop(v, 10));
+
+  std::thread producer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.push(42);
+  });
+  CHECK(q.pop(v));
+  CHECK(v == 42);
+  producer.join();
+}
+
+// every value arrives exactly once and in order per producer
+void test_mpsc() {
+  const int producers = 4, count = 100000;
+  MPSCQueue<std::pair<int, int>> q(64);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&q, p] {
+      for (int i = 0; i < count; ++i) {
+        while (!q.try_push({p, i})) std::this_thread::yield();
+      }
+    });
+  }
+
+  std::vector<int> next(producers, 0);
+  for (int n = 0; n < producers * count; ++n) {
+    std::pair<int, int> v;
+    REQUIRE(q.pop(v, 1000));
+    CHECK(v.second == next[v.first]++);
+  }
+  for (auto &t : threads) t.join();
+  CHECK(q.empty() && q.stats().dropped == 0);
+}
+
+// evicting from the producer side while the consumer pops loses values, never reorders them
+void test_drop_oldest_concurrent() {
+  const int count = 200000;
+  SPSCQueue<int> q(8, QueueFullPolicy::DropOldest);
+
+  std::thread producer([&] {
+    for (int i = 0; i < count; ++i) q.push(i);
+    q.push(-1);
+  });
+
+  int last = -1, popped = 0;
+  while (true) {
+    int v;
+    REQUIRE(q.pop(v, 1000));
+    if (v == -1) break;
+    CHECK(v > last);
+    last = v;
+    ++popped;
+  }
+  producer.join();
+
+  auto stats = q.stats();
+  CHECK(stats.pushed == count + 1);
+  CHECK(stats.dropped + popped + 1 == stats.pushed);
+  CHECK(stats.high_water <= q.capacity());
+}
+
+// a blocking producer waits for the consumer instead of losing anything
+void test_block() {
+  const int count = 100000;
+  SPSCQueue<int> q(4, QueueFullPolicy::Block);
+
+  std::thread producer([&] {
+    for (int i = 0; i < count; ++i) CHECK(q.push(i));
+  });
+  for (int i = 0; i < count; ++i) {
+    int v = -1;
+    REQUIRE(q.pop(v, 1000));
+    CHECK(v == i);
+  }
+  producer.join();
+  CHECK(q.empty() && q.stats().dropped == 0 && q.stats().pushed == count);
+}
+
+int main() {
+  return run_native_test([] {
+    test_policies();
+    test_blocking_pop();
+    test_mpsc();
+    test_drop_oldest_concurrent();
+    test_block();
+  });
+}
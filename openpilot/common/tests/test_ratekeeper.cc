@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <thread>
+
+#include "common/ratekeeper.h"
+#include "common/tests/native_test.h"
+
+void test_histogram() {
+  TimingHistogram h;
+  CHECK(h.count() == 0 && h.percentile(0.5) == 0);
+
+  for (int i = 0; i < 98; ++i) h.add(0.3);
+  h.add(7);
+  h.add(1000);
+  CHECK(h.count() == 100);
+  CHECK(h.buckets()[3] == 98);  // (0.2, 0.5]
+  CHECK(h.buckets()[7] == 1);   // (5, 10]
+  CHECK(h.buckets().back() == 1);
+  CHECK(h.percentile(0.5) == 0.5);
+  CHECK(h.percentile(0.99) == 10);
+  CHECK(h.percentile(1) == 1000);
+  CHECK(h.max() == 1000);
+
+  h.reset();
+  CHECK(h.count() == 0 && h.max() == 0);
+}
+
+void test_overruns() {
+  // a scheduling hiccup may overrun any of these, so only count what the slow iteration adds
+  RateKeeper rk("test", 20);
+  for (int i = 0; i < 10; ++i) {
+    rk.keepTime();
+  }
+  const uint64_t overruns = rk.stats().overruns;
+  CHECK(rk.totalOverruns() == overruns);
+
+  // a slow iteration misses its deadline
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  CHECK(rk.keepTime());
+  CHECK(rk.stats().overruns == overruns + 1 && rk.totalOverruns() == overruns + 1);
+  CHECK(rk.stats().duration.count() == 11);
+  CHECK(rk.stats().duration.max() >= 150);
+}
+
+int main() {
+  setenv("RATEKEEPER_STATS_INTERVAL", "0", 1);
+  return run_native_test([] {
+    test_histogram();
+    test_overruns();
+  });
+}
@@ -1,5 +1,9 @@
+#include <cstdio>
 #include <cstdlib>
+#include <map>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <zmq.h>
 
@@ -21,15 +25,20 @@ void test_swaglog() {
   CHECK(zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
   CHECK(zmq_bind(socket, Path::swaglog_ipc().c_str()) == 0);
 
+  auto recv_log = [socket]() {
+    char buffer[4096] = {};
+    const int size = zmq_recv(socket, buffer, sizeof(buffer), 0);
+    CHECK(size > 1 && size <= (int)sizeof(buffer));
+    std::string error;
+    const auto message = json11::Json::parse(std::string(buffer + 1, size - 1), error);
+    CHECK(error.empty());
+    CHECK(message["levelnum"].int_value() == buffer[0]);
+    return message;
+  };
+
   LOGD("native-cpp-log");
 
-  char buffer[4096] = {};
-  const int size = zmq_recv(socket, buffer, sizeof(buffer), 0);
-  CHECK(size > 1);
-  CHECK(buffer[0] == CLOUDLOG_DEBUG);
-  std::string error;
-  const auto message = json11::Json::parse(std::string(buffer + 1, size - 1), error);
-  CHECK(error.empty());
+  auto message = recv_log();
   CHECK(message["levelnum"].int_value() == CLOUDLOG_DEBUG);
   CHECK(message["msg"].string_value() == "native-cpp-log");
   CHECK(message["funcname"].string_value() == "test_swaglog");
@@ -38,6 +47,36 @@ void test_swaglog() {
   CHECK(message["ctx"]["dongle_id"].string_value() == "test_dongle_id");
   CHECK(message["ctx"]["dirty"].bool_value() == false);
 
+  // longer than the preallocated record
+  const std::string long_msg(2000, 'x');
+  LOGD("%s", long_msg.c_str());
+  CHECK(recv_log()["msg"].string_value() == long_msg);
+
+  // messages from each thread arrive in order, the ring is large enough for all of them
+  const int threads = 4, count = 50;
+  std::vector<std::thread> loggers;
+  for (int t = 0; t < threads; ++t) {
+    loggers.emplace_back([t] {
+      for (int i = 0; i < count; ++i) LOGD("%d %d", t, i);
+    });
+  }
+  for (auto &t : loggers) t.join();
+
+  std::map<int, int> next;
+  for (int n = 0; n < threads * count; ++n) {
+    int t = -1, i = -1;
+    CHECK(sscanf(recv_log()["msg"].string_value().c_str(), "%d %d", &t, &i) == 2);
+    CHECK(i == next[t]++);
+  }
+
+  // an error is sent on the calling thread, after everything queued before it
+  LOGD("queued before error");
+  LOGE("error");
+  CHECK(recv_log()["msg"].string_value() == "queued before error");
+  auto error_message = recv_log();
+  CHECK(error_message["levelnum"].int_value() == CLOUDLOG_ERROR);
+  CHECK(error_message["msg"].string_value() == "error");
+
   CHECK(zmq_close(socket) == 0);
   CHECK(zmq_ctx_destroy(context) == 0);
 }
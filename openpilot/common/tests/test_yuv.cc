@@ -0,0 +1,171 @@
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "common/yuv.h"
+
+static std::vector<uint8_t> random_bytes(std::mt19937 &rng, size_t size) {
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<uint8_t> v(size);
+  for (auto &b : v) b = dist(rng);
+  return v;
+}
+
+static std::vector<yuv::Isa> supported_isas() {
+  std::vector<yuv::Isa> isas;
+  for (yuv::Isa isa : {yuv::Isa::SSE2, yuv::Isa::AVX2, yuv::Isa::NEON}) {
+    if (yuv::set_isa(isa)) isas.push_back(isa);
+  }
+  return isas;
+}
+
+// every SIMD kernel set must match the scalar reference exactly, including row tails and padded strides
+void test_simd_matches_reference() {
+  const yuv::Isa initial = yuv::active_isa();
+  std::mt19937 rng(1234);
+
+  for (auto [width, height] : {std::pair{2, 2}, {18, 4}, {64, 8}, {98, 6}, {526, 330}, {1928, 16}}) {
+    const int stride = width + 24;
+    const auto y = random_bytes(rng, stride * height);
+    const auto uv = random_bytes(rng, stride * height / 2);
+    const auto u = random_bytes(rng, stride * height / 2);
+    const auto v = random_bytes(rng, stride * height / 2);
+
+    auto convert = [&](yuv::Isa isa) {
+      REQUIRE(yuv::set_isa(isa));
+      std::vector<uint8_t> i420(stride * height * 2), nv12(stride * height * 2), rgba(4 * stride * height);
+      uint8_t *dst_u = i420.data() + stride * height, *dst_v = dst_u + stride * height / 2;
+      yuv::nv12_to_i420(y.data(), stride, uv.data(), stride, i420.data(), stride, dst_u, stride, dst_v, stride, width, height);
+      yuv::i420_to_nv12(y.data(), stride, u.data(), stride, v.data(), stride, nv12.data(), stride,
+                        nv12.data() + stride * height, stride, width, height);
+      yuv::nv12_to_rgba(y.data(), stride, uv.data(), stride, rgba.data(), 4 * stride, width, height);
+      return std::make_tuple(i420, nv12, rgba);
+    };
+
+    const auto reference = convert(yuv::Isa::Scalar);
+    for (yuv::Isa isa : supported_isas()) {
+      CHECK(convert(isa) == reference);
+    }
+  }
+
+  REQUIRE(yuv::set_isa(initial));
+}
+
+void test_scale_filters() {
+  const int src_w = 64, src_h = 48;
+
+  // constant planes stay constant under every filter
+  std::vector<uint8_t> flat(src_w * src_h, 77);
+  for (auto filter : {yuv::ScaleFilter::Point, yuv::ScaleFilter::Bilinear, yuv::ScaleFilter::Box}) {
+    for (auto [dst_w, dst_h] : {std::pair{32, 24}, {21, 13}, {100, 70}}) {
+      std::vector<uint8_t> dst(dst_w * dst_h);
+      yuv::scale_plane(flat.data(), src_w, src_w, src_h, dst.data(), dst_w, dst_w, dst_h, filter);
+      for (uint8_t p : dst) CHECK(p == 77);
+    }
+  }
+
+  // horizontal ramp, 2x box downscale averages pixel pairs
+  std::vector<uint8_t> ramp(src_w * src_h);
+  for (int y = 0; y < src_h; ++y) {
+    for (int x = 0; x < src_w; ++x) ramp[y * src_w + x] = x * 2;
+  }
+  std::vector<uint8_t> dst(32 * 24);
+  yuv::scale_plane(ramp.data(), src_w, src_w, src_h, dst.data(), 32, 32, 24, yuv::ScaleFilter::Box);
+  for (int x = 0; x < 32; ++x) CHECK(dst[5 * 32 + x] == 4 * x + 1);
+
+  // bilinear with aligned centers samples between the same pairs
+  yuv::scale_plane(ramp.data(), src_w, src_w, src_h, dst.data(), 32, 32, 24, yuv::ScaleFilter::Bilinear);
+  for (int x = 0; x < 32; ++x) CHECK(dst[5 * 32 + x] == 4 * x + 1);
+
+  // point sampling keeps the libyuv kFilterNone indices
+  yuv::scale_plane(ramp.data(), src_w, src_w, src_h, dst.data(), 32, 32, 24, yuv::ScaleFilter::Point);
+  for (int x = 0; x < 32; ++x) CHECK(dst[5 * 32 + x] == ramp[x * src_w / 32]);
+}
+
+// the fused NV12 scalers match converting first and point scaling after
+void test_fused_nv12_scale() {
+  std::mt19937 rng(42);
+  const int src_w = 1928, src_h = 64, stride = 2048;
+  const int dst_w = 526, dst_h = 18;
+  const auto y = random_bytes(rng, stride * src_h);
+  const auto uv = random_bytes(rng, stride * src_h / 2);
+
+  std::vector<uint8_t> i420(src_w * src_h * 3 / 2);
+  uint8_t *u = i420.data() + src_w * src_h, *v = u + src_w * src_h / 4;
+  yuv::nv12_to_i420(y.data(), stride, uv.data(), stride, i420.data(), src_w, u, src_w / 2, v, src_w / 2, src_w, src_h);
+  std::vector<uint8_t> expected(dst_w * dst_h * 3 / 2);
+  uint8_t *eu = expected.data() + dst_w * dst_h, *ev = eu + dst_w * dst_h / 4;
+  yuv::i420_scale(i420.data(), src_w, u, src_w / 2, v, src_w / 2, src_w, src_h,
+                  expected.data(), dst_w, eu, dst_w / 2, ev, dst_w / 2, dst_w, dst_h);
+
+  std::vector<uint8_t> fused(expected.size());
+  uint8_t *fu = fused.data() + dst_w * dst_h, *fv = fu + dst_w * dst_h / 4;
+  yuv::nv12_scale_to_i420(y.data(), stride, uv.data(), stride, src_w, src_h,
+                          fused.data(), dst_w, fu, dst_w / 2, fv, dst_w / 2, dst_w, dst_h);
+  CHECK(fused == expected);
+
+  std::vector<uint8_t> nv12(expected.size()), nv12_i420(expected.size());
+  yuv::nv12_scale(y.data(), stride, uv.data(), stride, src_w, src_h,
+                  nv12.data(), dst_w, nv12.data() + dst_w * dst_h, dst_w, dst_w, dst_h);
+  uint8_t *nu = nv12_i420.data() + dst_w * dst_h, *nv = nu + dst_w * dst_h / 4;
+  yuv::nv12_to_i420(nv12.data(), dst_w, nv12.data() + dst_w * dst_h, dst_w,
+                    nv12_i420.data(), dst_w, nu, dst_w / 2, nv, dst_w / 2, dst_w, dst_h);
+  CHECK(nv12_i420 == expected);
+}
+
+// the 2x/4x box kernels match the generic box filter, and NV12 box scaling matches converting first
+void test_box_downscale() {
+  const yuv::Isa initial = yuv::active_isa();
+  std::mt19937 rng(7);
+  const int src_w = 1928, src_h = 48, stride = 2048;
+  const auto y = random_bytes(rng, stride * src_h);
+  const auto uv = random_bytes(rng, stride * src_h / 2);
+
+  std::vector<uint8_t> i420(src_w * src_h * 3 / 2);
+  uint8_t *u = i420.data() + src_w * src_h, *v = u + src_w * src_h / 4;
+  yuv::nv12_to_i420(y.data(), stride, uv.data(), stride, i420.data(), src_w, u, src_w / 2, v, src_w / 2, src_w, src_h);
+
+  for (int factor : {2, 4}) {
+    const int dst_w = src_w / factor, dst_h = src_h / factor;
+    // reference: plain averages, computed independently of the library
+    std::vector<uint8_t> expected(dst_w * dst_h);
+    for (int dy = 0; dy < dst_h; ++dy) {
+      for (int dx = 0; dx < dst_w; ++dx) {
+        int sum = 0;
+        for (int sy = 0; sy < factor; ++sy) {
+          for (int sx = 0; sx < factor; ++sx) sum += y[(dy * factor + sy) * stride + dx * factor + sx];
+        }
+        expected[dy * dst_w + dx] = (sum + factor * factor / 2) / (factor * factor);
+      }
+    }
+
+    for (yuv::Isa isa : {yuv::Isa::Scalar, yuv::Isa::SSE2, yuv::Isa::AVX2, yuv::Isa::NEON}) {
+      if (!yuv::set_isa(isa)) continue;
+      std::vector<uint8_t> dst(dst_w * dst_h);
+      yuv::scale_plane(y.data(), stride, src_w, src_h, dst.data(), dst_w, dst_w, dst_h, yuv::ScaleFilter::Box);
+      CHECK(dst == expected);
+
+      std::vector<uint8_t> converted(dst_w * dst_h * 3 / 2), direct(dst_w * dst_h * 3 / 2);
+      uint8_t *cu = converted.data() + dst_w * dst_h, *cv = cu + dst_w * dst_h / 4;
+      yuv::i420_scale(i420.data(), src_w, u, src_w / 2, v, src_w / 2, src_w, src_h,
+                      converted.data(), dst_w, cu, dst_w / 2, cv, dst_w / 2, dst_w, dst_h, yuv::ScaleFilter::Box);
+      uint8_t *du = direct.data() + dst_w * dst_h, *dv = du + dst_w * dst_h / 4;
+      yuv::nv12_scale_to_i420(y.data(), stride, uv.data(), stride, src_w, src_h,
+                              direct.data(), dst_w, du, dst_w / 2, dv, dst_w / 2, dst_w, dst_h, yuv::ScaleFilter::Box);
+      CHECK(direct == converted);
+    }
+  }
+
+  REQUIRE(yuv::set_isa(initial));
+}
+
+int main() {
+  return run_native_test([] {
+    test_simd_matches_reference();
+    test_scale_filters();
+    test_fused_nv12_scale();
+    test_box_downscale();
+  });
+}
@@ -47,6 +47,19 @@ int set_realtime_priority(int level) {
 #endif
 }
 
+int set_background_priority() {
+#ifdef __linux__
+  long tid = syscall(SYS_gettid);
+
+  struct sched_param sa;
+  memset(&sa, 0, sizeof(sa));
+  int ret = sched_setscheduler(tid, SCHED_OTHER, &sa);
+  return ret != 0 ? ret : setpriority(PRIO_PROCESS, tid, 10);
+#else
+  return -1;
+#endif
+}
+
 int set_core_affinity(std::vector<int> cores) {
 #ifdef __linux__
   long tid = syscall(SYS_gettid);
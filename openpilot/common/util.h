@@ -43,6 +43,8 @@ namespace util {
 
 void set_thread_name(const char* name);
 int set_realtime_priority(int level);
+// normal scheduling at a low nice level for the calling thread, e.g. for background work in a realtime process
+int set_background_priority();
 int set_core_affinity(std::vector<int> cores);
 int set_file_descriptor_limit(uint64_t limit);
 
@@ -1,7 +1,17 @@
 #include "common/yuv.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define YUV_NEON 1
+#include <arm_neon.h>
+#endif
 
 namespace yuv {
 
@@ -23,34 +33,536 @@ void copy_plane(const uint8_t *src, int src_stride,
   }
 }
 
+// BT.601 limited range → RGB (integer form used widely, incl. similar to libyuv).
+inline void yuv_to_rgb(int y, int u, int v, uint8_t *r, uint8_t *g, uint8_t *b) {
+  const int c = (y - 16) * 298;
+  const int d = u - 128;
+  const int e = v - 128;
+  *r = clamp_u8((c + 409 * e + 128) >> 8);
+  *g = clamp_u8((c - 100 * d - 208 * e + 128) >> 8);
+  *b = clamp_u8((c + 516 * d + 128) >> 8);
+}
+
+// ***** scalar reference row kernels *****
+
+void deinterleave_row_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int n) {
+  for (int x = 0; x < n; ++x) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+void interleave_row_c(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n) {
+  for (int x = 0; x < n; ++x) {
+    uv[2 * x] = u[x];
+    uv[2 * x + 1] = v[x];
+  }
+}
+
+void nv12_rgba_row_c(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *dst, int width) {
+  for (int x = 0; x < width; ++x) {
+    const int uv_x = (x & ~1);
+    uint8_t r, g, b;
+    yuv_to_rgb(y_row[x], uv_row[uv_x], uv_row[uv_x + 1], &r, &g, &b);
+    dst[4 * x + 0] = r;
+    dst[4 * x + 1] = g;
+    dst[4 * x + 2] = b;
+    dst[4 * x + 3] = 255;
+  }
+}
+
+// 2x2 and 4x4 box downscale of one output row, reading 2 or 4 source rows
+void box2_row_c(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  const uint8_t *r0 = src, *r1 = src + src_stride;
+  for (int x = 0; x < dst_width; ++x) {
+    dst[x] = (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2;
+  }
+}
+
+void box4_row_c(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  for (int x = 0; x < dst_width; ++x) {
+    int sum = 0;
+    for (int r = 0; r < 4; ++r) {
+      const uint8_t *p = src + r * src_stride + 4 * x;
+      sum += p[0] + p[1] + p[2] + p[3];
+    }
+    dst[x] = (sum + 8) >> 4;
+  }
+}
+
+// ***** x86 row kernels *****
+// each processes the multiple-of-block part of the row and leaves the tail to the scalar kernel
+
+#ifdef YUV_X86
+
+void deinterleave_row_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n) {
+  const __m128i mask = _mm_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const __m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * x));
+    const __m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * x + 16));
+    _mm_storeu_si128((__m128i *)(u + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+    _mm_storeu_si128((__m128i *)(v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+  }
+  deinterleave_row_c(uv + 2 * x, u + x, v + x, n - x);
+}
+
+void interleave_row_sse2(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n) {
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const __m128i a = _mm_loadu_si128((const __m128i *)(u + x));
+    const __m128i b = _mm_loadu_si128((const __m128i *)(v + x));
+    _mm_storeu_si128((__m128i *)(uv + 2 * x), _mm_unpacklo_epi8(a, b));
+    _mm_storeu_si128((__m128i *)(uv + 2 * x + 16), _mm_unpackhi_epi8(a, b));
+  }
+  interleave_row_c(u + x, v + x, uv + 2 * x, n - x);
+}
+
+// 8 pixels per iteration. products are formed with madd on (c, e) / (c, d) int16 pairs,
+// so the 32 bit results match the scalar math exactly, and the saturating packs do the clamp.
+void nv12_rgba_row_sse2(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *dst, int width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i k16 = _mm_set1_epi16(16);
+  const __m128i k128 = _mm_set1_epi16(128);
+  const __m128i round = _mm_set1_epi32(128);
+  const __m128i kr = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+  const __m128i kg = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+  const __m128i kge = _mm_setr_epi16(-208, 0, -208, 0, -208, 0, -208, 0);
+  const __m128i kb = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+  const __m128i alpha = _mm_set1_epi8((char)255);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y_row + x)), zero), k16);
+    const __m128i uv = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(uv_row + x)), zero), k128);
+
+    // [u0 v0 u1 v1 ...] -> per pixel [u0 u0 u1 u1 ...] and [v0 v0 v1 v1 ...]
+    __m128i d = _mm_srai_epi32(_mm_slli_epi32(uv, 16), 16);
+    __m128i e = _mm_srai_epi32(uv, 16);
+    d = _mm_packs_epi32(d, d);
+    e = _mm_packs_epi32(e, e);
+    d = _mm_unpacklo_epi16(d, d);
+    e = _mm_unpacklo_epi16(e, e);
+
+    const __m128i ce_lo = _mm_unpacklo_epi16(c, e), ce_hi = _mm_unpackhi_epi16(c, e);
+    const __m128i cd_lo = _mm_unpacklo_epi16(c, d), cd_hi = _mm_unpackhi_epi16(c, d);
+    const __m128i e0_lo = _mm_unpacklo_epi16(e, zero), e0_hi = _mm_unpackhi_epi16(e, zero);
+
+    const __m128i r_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, kr), round), 8);
+    const __m128i r_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, kr), round), 8);
+    const __m128i g_lo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, kg), _mm_madd_epi16(e0_lo, kge)), round), 8);
+    const __m128i g_hi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, kg), _mm_madd_epi16(e0_hi, kge)), round), 8);
+    const __m128i b_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, kb), round), 8);
+    const __m128i b_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, kb), round), 8);
+
+    const __m128i r = _mm_packus_epi16(_mm_packs_epi32(r_lo, r_hi), zero);
+    const __m128i g = _mm_packus_epi16(_mm_packs_epi32(g_lo, g_hi), zero);
+    const __m128i b = _mm_packus_epi16(_mm_packs_epi32(b_lo, b_hi), zero);
+
+    const __m128i rg = _mm_unpacklo_epi8(r, g);
+    const __m128i ba = _mm_unpacklo_epi8(b, alpha);
+    _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *)(dst + 4 * x + 16), _mm_unpackhi_epi16(rg, ba));
+  }
+  nv12_rgba_row_c(y_row + x, uv_row + x, dst + 4 * x, width - x);
+}
+
+// sums of horizontal byte pairs as 16 bit lanes
+inline __m128i pair_sums_sse2(__m128i v) {
+  const __m128i mask = _mm_set1_epi16(0x00ff);
+  return _mm_add_epi16(_mm_and_si128(v, mask), _mm_srli_epi16(v, 8));
+}
+
+void box2_row_sse2(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  const uint8_t *r0 = src, *r1 = src + src_stride;
+  const __m128i round = _mm_set1_epi16(2);
+  int x = 0;
+  for (; x + 16 <= dst_width; x += 16) {
+    __m128i out[2];
+    for (int i = 0; i < 2; ++i) {
+      const __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x + 16 * i));
+      const __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x + 16 * i));
+      out[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pair_sums_sse2(a), pair_sums_sse2(b)), round), 2);
+    }
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(out[0], out[1]));
+  }
+  box2_row_c(src + 2 * x, src_stride, dst + x, dst_width - x);
+}
+
+void box4_row_sse2(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i round = _mm_set1_epi32(8);
+  int x = 0;
+  for (; x + 16 <= dst_width; x += 16) {
+    __m128i quads[4];
+    for (int i = 0; i < 4; ++i) {
+      // 8 column pair sums over the 4 rows, at most 2040, then adjacent pairs summed into 4 x 32 bit
+      __m128i sum = _mm_setzero_si128();
+      for (int r = 0; r < 4; ++r) {
+        sum = _mm_add_epi16(sum, pair_sums_sse2(_mm_loadu_si128((const __m128i *)(src + r * src_stride + 4 * x + 16 * i))));
+      }
+      quads[i] = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(sum, ones), round), 4);
+    }
+    const __m128i lo = _mm_packs_epi32(quads[0], quads[1]);
+    const __m128i hi = _mm_packs_epi32(quads[2], quads[3]);
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+  }
+  box4_row_c(src + 4 * x, src_stride, dst + x, dst_width - x);
+}
+
+__attribute__((target("avx2")))
+void deinterleave_row_avx2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= n; x += 32) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *)(uv + 2 * x));
+    const __m256i b = _mm256_loadu_si256((const __m256i *)(uv + 2 * x + 32));
+    // packus works per 128 bit lane, restore the 64 bit chunk order afterwards
+    const __m256i pu = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    const __m256i pv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+    _mm256_storeu_si256((__m256i *)(u + x), _mm256_permute4x64_epi64(pu, 0xd8));
+    _mm256_storeu_si256((__m256i *)(v + x), _mm256_permute4x64_epi64(pv, 0xd8));
+  }
+  deinterleave_row_sse2(uv + 2 * x, u + x, v + x, n - x);
+}
+
+__attribute__((target("avx2")))
+void interleave_row_avx2(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n) {
+  int x = 0;
+  for (; x + 32 <= n; x += 32) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *)(u + x));
+    const __m256i b = _mm256_loadu_si256((const __m256i *)(v + x));
+    const __m256i lo = _mm256_unpacklo_epi8(a, b);
+    const __m256i hi = _mm256_unpackhi_epi8(a, b);
+    _mm256_storeu_si256((__m256i *)(uv + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(uv + 2 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  interleave_row_sse2(u + x, v + x, uv + 2 * x, n - x);
+}
+
+// same math as the SSE2 kernel, 16 pixels per iteration with pixels 0-7 in the low lane and 8-15 in the high lane
+__attribute__((target("avx2")))
+void nv12_rgba_row_avx2(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *dst, int width) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i k16 = _mm256_set1_epi16(16);
+  const __m256i k128 = _mm256_set1_epi16(128);
+  const __m256i round = _mm256_set1_epi32(128);
+  const __m256i kr = _mm256_set1_epi32((409 << 16) | 298);
+  const __m256i kg = _mm256_set1_epi32((int)(0xff9c0000u | 298));  // (298, -100)
+  const __m256i kge = _mm256_set1_epi32(0x0000ff30);               // (-208, 0)
+  const __m256i kb = _mm256_set1_epi32((516 << 16) | 298);
+  const __m256i alpha = _mm256_set1_epi8((char)255);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m256i c = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y_row + x))), k16);
+    const __m256i uv = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(uv_row + x))), k128);
+
+    __m256i d = _mm256_srai_epi32(_mm256_slli_epi32(uv, 16), 16);
+    __m256i e = _mm256_srai_epi32(uv, 16);
+    d = _mm256_packs_epi32(d, d);
+    e = _mm256_packs_epi32(e, e);
+    d = _mm256_unpacklo_epi16(d, d);
+    e = _mm256_unpacklo_epi16(e, e);
+
+    const __m256i ce_lo = _mm256_unpacklo_epi16(c, e), ce_hi = _mm256_unpackhi_epi16(c, e);
+    const __m256i cd_lo = _mm256_unpacklo_epi16(c, d), cd_hi = _mm256_unpackhi_epi16(c, d);
+    const __m256i e0_lo = _mm256_unpacklo_epi16(e, zero), e0_hi = _mm256_unpackhi_epi16(e, zero);
+
+    const __m256i r_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_lo, kr), round), 8);
+    const __m256i r_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_hi, kr), round), 8);
+    const __m256i g_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_lo, kg), _mm256_madd_epi16(e0_lo, kge)), round), 8);
+    const __m256i g_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_hi, kg), _mm256_madd_epi16(e0_hi, kge)), round), 8);
+    const __m256i b_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_lo, kb), round), 8);
+    const __m256i b_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_hi, kb), round), 8);
+
+    const __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(r_lo, r_hi), zero);
+    const __m256i g = _mm256_packus_epi16(_mm256_packs_epi32(g_lo, g_hi), zero);
+    const __m256i b = _mm256_packus_epi16(_mm256_packs_epi32(b_lo, b_hi), zero);
+
+    const __m256i rg = _mm256_unpacklo_epi8(r, g);
+    const __m256i ba = _mm256_unpacklo_epi8(b, alpha);
+    const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+    const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+    _mm256_storeu_si256((__m256i *)(dst + 4 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 4 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  nv12_rgba_row_sse2(y_row + x, uv_row + x, dst + 4 * x, width - x);
+}
+
+#endif  // YUV_X86
+
+// ***** NEON row kernels *****
+
+#ifdef YUV_NEON
+
+void deinterleave_row_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int n) {
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const uint8x16x2_t p = vld2q_u8(uv + 2 * x);
+    vst1q_u8(u + x, p.val[0]);
+    vst1q_u8(v + x, p.val[1]);
+  }
+  deinterleave_row_c(uv + 2 * x, u + x, v + x, n - x);
+}
+
+void interleave_row_neon(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n) {
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const uint8x16x2_t p = {vld1q_u8(u + x), vld1q_u8(v + x)};
+    vst2q_u8(uv + 2 * x, p);
+  }
+  interleave_row_c(u + x, v + x, uv + 2 * x, n - x);
+}
+
+void box2_row_neon(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  const uint8_t *r0 = src, *r1 = src + src_stride;
+  int x = 0;
+  for (; x + 8 <= dst_width; x += 8) {
+    uint16x8_t sum = vpaddlq_u8(vld1q_u8(r0 + 2 * x));
+    sum = vpadalq_u8(sum, vld1q_u8(r1 + 2 * x));
+    vst1_u8(dst + x, vrshrn_n_u16(sum, 2));
+  }
+  box2_row_c(src + 2 * x, src_stride, dst + x, dst_width - x);
+}
+
+void box4_row_neon(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width) {
+  int x = 0;
+  for (; x + 8 <= dst_width; x += 8) {
+    uint16x4_t half[2];
+    for (int i = 0; i < 2; ++i) {
+      uint16x8_t sum = vdupq_n_u16(0);
+      for (int r = 0; r < 4; ++r) {
+        sum = vpadalq_u8(sum, vld1q_u8(src + r * src_stride + 4 * x + 16 * i));
+      }
+      half[i] = vrshrn_n_u32(vpaddlq_u16(sum), 4);
+    }
+    vst1_u8(dst + x, vmovn_u16(vcombine_u16(half[0], half[1])));
+  }
+  box4_row_c(src + 4 * x, src_stride, dst + x, dst_width - x);
+}
+
+inline uint8x8_t neon_rgb_channel(int32x4_t lo, int32x4_t hi) {
+  const int32x4_t round = vdupq_n_s32(128);
+  lo = vshrq_n_s32(vaddq_s32(lo, round), 8);
+  hi = vshrq_n_s32(vaddq_s32(hi, round), 8);
+  return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+// 8 pixels with per pixel chroma already duplicated
+inline void neon_rgba8(int16x8_t c, int16x8_t d, int16x8_t e, uint8_t *dst) {
+  const int16x4_t c_lo = vget_low_s16(c), c_hi = vget_high_s16(c);
+  const int16x4_t d_lo = vget_low_s16(d), d_hi = vget_high_s16(d);
+  const int16x4_t e_lo = vget_low_s16(e), e_hi = vget_high_s16(e);
+  const int32x4_t y_lo = vmull_n_s16(c_lo, 298), y_hi = vmull_n_s16(c_hi, 298);
+
+  uint8x8x4_t rgba;
+  rgba.val[0] = neon_rgb_channel(vmlal_n_s16(y_lo, e_lo, 409), vmlal_n_s16(y_hi, e_hi, 409));
+  rgba.val[1] = neon_rgb_channel(vmlal_n_s16(vmlal_n_s16(y_lo, d_lo, -100), e_lo, -208),
+                                 vmlal_n_s16(vmlal_n_s16(y_hi, d_hi, -100), e_hi, -208));
+  rgba.val[2] = neon_rgb_channel(vmlal_n_s16(y_lo, d_lo, 516), vmlal_n_s16(y_hi, d_hi, 516));
+  rgba.val[3] = vdup_n_u8(255);
+  vst4_u8(dst, rgba);
+}
+
+void nv12_rgba_row_neon(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *dst, int width) {
+  const int16x8_t k16 = vdupq_n_s16(16);
+  const int16x8_t k128 = vdupq_n_s16(128);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const uint8x16_t yv = vld1q_u8(y_row + x);
+    const uint8x8x2_t uv = vld2_u8(uv_row + x);
+    const int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uv.val[0])), k128);
+    const int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uv.val[1])), k128);
+    const int16x8x2_t dd = vzipq_s16(d, d);
+    const int16x8x2_t ee = vzipq_s16(e, e);
+    const int16x8_t c_lo = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv))), k16);
+    const int16x8_t c_hi = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv))), k16);
+    neon_rgba8(c_lo, dd.val[0], ee.val[0], dst + 4 * x);
+    neon_rgba8(c_hi, dd.val[1], ee.val[1], dst + 4 * x + 32);
+  }
+  nv12_rgba_row_c(y_row + x, uv_row + x, dst + 4 * x, width - x);
+}
+
+#endif  // YUV_NEON
+
+// ***** dispatch *****
+
+struct Kernels {
+  Isa isa;
+  void (*deinterleave_row)(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+  void (*interleave_row)(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n);
+  void (*nv12_rgba_row)(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *dst, int width);
+  void (*box2_row)(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width);
+  void (*box4_row)(const uint8_t *src, int src_stride, uint8_t *dst, int dst_width);
+};
+
+const Kernels scalar_kernels = {Isa::Scalar, deinterleave_row_c, interleave_row_c, nv12_rgba_row_c, box2_row_c, box4_row_c};
+#ifdef YUV_X86
+const Kernels sse2_kernels = {Isa::SSE2, deinterleave_row_sse2, interleave_row_sse2, nv12_rgba_row_sse2, box2_row_sse2, box4_row_sse2};
+// the box kernels are load bound, SSE2 is as fast as AVX2 there
+const Kernels avx2_kernels = {Isa::AVX2, deinterleave_row_avx2, interleave_row_avx2, nv12_rgba_row_avx2, box2_row_sse2, box4_row_sse2};
+#endif
+#ifdef YUV_NEON
+const Kernels neon_kernels = {Isa::NEON, deinterleave_row_neon, interleave_row_neon, nv12_rgba_row_neon, box2_row_neon, box4_row_neon};
+#endif
+
+const Kernels *kernels_for(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar: return &scalar_kernels;
+#ifdef YUV_X86
+    case Isa::SSE2: return &sse2_kernels;
+    case Isa::AVX2: return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+#endif
+#ifdef YUV_NEON
+    case Isa::NEON: return &neon_kernels;
+#endif
+    default: return nullptr;
+  }
+}
+
+const Kernels *best_kernels() {
+  for (Isa isa : {Isa::AVX2, Isa::NEON, Isa::SSE2}) {
+    if (const Kernels *k = kernels_for(isa)) return k;
+  }
+  return &scalar_kernels;
+}
+
+std::atomic<const Kernels *> &active_kernels() {
+  static std::atomic<const Kernels *> kernels{best_kernels()};
+  return kernels;
+}
+
+inline const Kernels &kernels() {
+  return *active_kernels().load(std::memory_order_relaxed);
+}
+
+// ***** scalers *****
+
+// source index for each destination index, so the inner loops don't divide
+const std::vector<int> &point_table(int src_size, int dst_size) {
+  thread_local std::vector<int> table;
+  table.resize(dst_size);
+  for (int i = 0; i < dst_size; ++i) {
+    table[i] = static_cast<int>(static_cast<int64_t>(i) * src_size / dst_size);
+  }
+  return table;
+}
+
 void scale_plane_point(const uint8_t *src, int src_stride, int src_width, int src_height,
                        uint8_t *dst, int dst_stride, int dst_width, int dst_height) {
-  if (src_width == dst_width && src_height == dst_height) {
-    copy_plane(src, src_stride, dst, dst_stride, dst_width, dst_height);
-    return;
-  }
+  const std::vector<int> &xs = point_table(src_width, dst_width);
   for (int y = 0; y < dst_height; ++y) {
-    const int sy = y * src_height / dst_height;
+    const int sy = static_cast<int>(static_cast<int64_t>(y) * src_height / dst_height);
     const uint8_t *src_row = src + sy * src_stride;
     uint8_t *dst_row = dst + y * dst_stride;
     for (int x = 0; x < dst_width; ++x) {
-      dst_row[x] = src_row[x * src_width / dst_width];
+      dst_row[x] = src_row[xs[x]];
     }
   }
 }
 
-// BT.601 limited range → RGB (integer form used widely, incl. similar to libyuv).
-inline void yuv_to_rgb(int y, int u, int v, uint8_t *r, uint8_t *g, uint8_t *b) {
-  const int c = (y - 16) * 298;
-  const int d = u - 128;
-  const int e = v - 128;
-  *r = clamp_u8((c + 409 * e + 128) >> 8);
-  *g = clamp_u8((c - 100 * d - 208 * e + 128) >> 8);
-  *b = clamp_u8((c + 516 * d + 128) >> 8);
+struct LerpStep {
+  int i0, i1;
+  int w1;  // 8 bit weight of i1
+};
+
+void lerp_table(int src_size, int dst_size, std::vector<LerpStep> &table) {
+  table.resize(dst_size);
+  for (int i = 0; i < dst_size; ++i) {
+    // align pixel centers, in 16.16 fixed point
+    int64_t pos = ((2 * static_cast<int64_t>(i) + 1) * src_size * 65536) / (2 * dst_size) - 32768;
+    pos = std::clamp<int64_t>(pos, 0, static_cast<int64_t>(src_size - 1) * 65536);
+    const int i0 = static_cast<int>(pos >> 16);
+    table[i] = {i0, std::min(i0 + 1, src_size - 1), static_cast<int>((pos & 0xffff) >> 8)};
+  }
+}
+
+void scale_plane_bilinear(const uint8_t *src, int src_stride, int src_width, int src_height,
+                          uint8_t *dst, int dst_stride, int dst_width, int dst_height) {
+  thread_local std::vector<LerpStep> xs, ys;
+  thread_local std::vector<uint16_t> row;
+  lerp_table(src_width, dst_width, xs);
+  lerp_table(src_height, dst_height, ys);
+  row.resize(src_width);
+
+  for (int y = 0; y < dst_height; ++y) {
+    // vertical blend into 8.8 fixed point, this loop vectorizes
+    const uint8_t *r0 = src + ys[y].i0 * src_stride;
+    const uint8_t *r1 = src + ys[y].i1 * src_stride;
+    const int w1 = ys[y].w1, w0 = 256 - w1;
+    for (int x = 0; x < src_width; ++x) {
+      row[x] = static_cast<uint16_t>(r0[x] * w0 + r1[x] * w1);
+    }
+
+    uint8_t *dst_row = dst + y * dst_stride;
+    for (int x = 0; x < dst_width; ++x) {
+      const LerpStep &s = xs[x];
+      dst_row[x] = static_cast<uint8_t>((row[s.i0] * (256 - s.w1) + row[s.i1] * s.w1 + (1 << 15)) >> 16);
+    }
+  }
+}
+
+void scale_plane_box(const uint8_t *src, int src_stride, int src_width, int src_height,
+                     uint8_t *dst, int dst_stride, int dst_width, int dst_height) {
+  // exact 2x and 4x downscales have SIMD kernels
+  for (int factor : {2, 4}) {
+    if (src_width == dst_width * factor && src_height == dst_height * factor) {
+      const auto box_row = factor == 2 ? kernels().box2_row : kernels().box4_row;
+      for (int y = 0; y < dst_height; ++y) {
+        box_row(src + y * factor * src_stride, src_stride, dst + y * dst_stride, dst_width);
+      }
+      return;
+    }
+  }
+
+  thread_local std::vector<uint32_t> column_sums;
+  thread_local std::vector<int> x_begin;
+  column_sums.resize(src_width);
+  x_begin.resize(dst_width + 1);
+  for (int x = 0; x <= dst_width; ++x) {
+    x_begin[x] = static_cast<int>(static_cast<int64_t>(x) * src_width / dst_width);
+  }
+
+  for (int y = 0; y < dst_height; ++y) {
+    const int y0 = static_cast<int>(static_cast<int64_t>(y) * src_height / dst_height);
+    const int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * src_height / dst_height));
+
+    std::fill(column_sums.begin(), column_sums.end(), 0);
+    for (int sy = y0; sy < y1; ++sy) {
+      const uint8_t *src_row = src + sy * src_stride;
+      for (int x = 0; x < src_width; ++x) {
+        column_sums[x] += src_row[x];
+      }
+    }
+
+    uint8_t *dst_row = dst + y * dst_stride;
+    for (int x = 0; x < dst_width; ++x) {
+      const int x0 = x_begin[x];
+      const int x1 = std::max(x0 + 1, x_begin[x + 1]);
+      uint32_t sum = 0;
+      for (int sx = x0; sx < x1; ++sx) {
+        sum += column_sums[sx];
+      }
+      const uint32_t count = (x1 - x0) * (y1 - y0);
+      dst_row[x] = static_cast<uint8_t>((sum + count / 2) / count);
+    }
+  }
 }
 
 }  // namespace
 
+Isa active_isa() {
+  return kernels().isa;
+}
+
+bool set_isa(Isa isa) {
+  const Kernels *k = kernels_for(isa);
+  if (!k) return false;
+  active_kernels().store(k);
+  return true;
+}
+
 void nv12_to_i420(const uint8_t *src_y, int src_stride_y,
                   const uint8_t *src_uv, int src_stride_uv,
                   uint8_t *dst_y, int dst_stride_y,
@@ -59,16 +571,11 @@ void nv12_to_i420(const uint8_t *src_y, int src_stride_y,
                   int width, int height) {
   copy_plane(src_y, src_stride_y, dst_y, dst_stride_y, width, height);
 
+  const auto deinterleave_row = kernels().deinterleave_row;
   const int uv_width = width / 2;
   const int uv_height = height / 2;
   for (int y = 0; y < uv_height; ++y) {
-    const uint8_t *uv = src_uv + y * src_stride_uv;
-    uint8_t *u = dst_u + y * dst_stride_u;
-    uint8_t *v = dst_v + y * dst_stride_v;
-    for (int x = 0; x < uv_width; ++x) {
-      u[x] = uv[2 * x];
-      v[x] = uv[2 * x + 1];
-    }
+    deinterleave_row(src_uv + y * src_stride_uv, dst_u + y * dst_stride_u, dst_v + y * dst_stride_v, uv_width);
   }
 }
 
@@ -80,16 +587,31 @@ void i420_to_nv12(const uint8_t *src_y, int src_stride_y,
                   int width, int height) {
   copy_plane(src_y, src_stride_y, dst_y, dst_stride_y, width, height);
 
+  const auto interleave_row = kernels().interleave_row;
   const int uv_width = width / 2;
   const int uv_height = height / 2;
   for (int y = 0; y < uv_height; ++y) {
-    const uint8_t *u = src_u + y * src_stride_u;
-    const uint8_t *v = src_v + y * src_stride_v;
-    uint8_t *uv = dst_uv + y * dst_stride_uv;
-    for (int x = 0; x < uv_width; ++x) {
-      uv[2 * x] = u[x];
-      uv[2 * x + 1] = v[x];
-    }
+    interleave_row(src_u + y * src_stride_u, src_v + y * src_stride_v, dst_uv + y * dst_stride_uv, uv_width);
+  }
+}
+
+void scale_plane(const uint8_t *src, int src_stride, int src_width, int src_height,
+                 uint8_t *dst, int dst_stride, int dst_width, int dst_height,
+                 ScaleFilter filter) {
+  if (src_width == dst_width && src_height == dst_height) {
+    copy_plane(src, src_stride, dst, dst_stride, dst_width, dst_height);
+    return;
+  }
+  switch (filter) {
+    case ScaleFilter::Point:
+      scale_plane_point(src, src_stride, src_width, src_height, dst, dst_stride, dst_width, dst_height);
+      break;
+    case ScaleFilter::Bilinear:
+      scale_plane_bilinear(src, src_stride, src_width, src_height, dst, dst_stride, dst_width, dst_height);
+      break;
+    case ScaleFilter::Box:
+      scale_plane_box(src, src_stride, src_width, src_height, dst, dst_stride, dst_width, dst_height);
+      break;
   }
 }
 
@@ -100,32 +622,107 @@ void i420_scale(const uint8_t *src_y, int src_stride_y,
                 uint8_t *dst_y, int dst_stride_y,
                 uint8_t *dst_u, int dst_stride_u,
                 uint8_t *dst_v, int dst_stride_v,
+                int dst_width, int dst_height,
+                ScaleFilter filter) {
+  scale_plane(src_y, src_stride_y, src_width, src_height,
+              dst_y, dst_stride_y, dst_width, dst_height, filter);
+  scale_plane(src_u, src_stride_u, src_width / 2, src_height / 2,
+              dst_u, dst_stride_u, dst_width / 2, dst_height / 2, filter);
+  scale_plane(src_v, src_stride_v, src_width / 2, src_height / 2,
+              dst_v, dst_stride_v, dst_width / 2, dst_height / 2, filter);
+}
+
+void nv12_scale_to_i420(const uint8_t *src_y, int src_stride_y,
+                        const uint8_t *src_uv, int src_stride_uv,
+                        int src_width, int src_height,
+                        uint8_t *dst_y, int dst_stride_y,
+                        uint8_t *dst_u, int dst_stride_u,
+                        uint8_t *dst_v, int dst_stride_v,
+                        int dst_width, int dst_height,
+                        ScaleFilter filter) {
+  scale_plane(src_y, src_stride_y, src_width, src_height,
+              dst_y, dst_stride_y, dst_width, dst_height, filter);
+
+  const int src_uv_width = src_width / 2, src_uv_height = src_height / 2;
+  const int dst_uv_width = dst_width / 2, dst_uv_height = dst_height / 2;
+  const auto deinterleave_row = kernels().deinterleave_row;
+
+  if (filter == ScaleFilter::Point) {
+    const std::vector<int> &xs = point_table(src_uv_width, dst_uv_width);
+    for (int y = 0; y < dst_uv_height; ++y) {
+      const int sy = static_cast<int>(static_cast<int64_t>(y) * src_uv_height / dst_uv_height);
+      const uint8_t *uv = src_uv + sy * src_stride_uv;
+      uint8_t *u = dst_u + y * dst_stride_u;
+      uint8_t *v = dst_v + y * dst_stride_v;
+      for (int x = 0; x < dst_uv_width; ++x) {
+        u[x] = uv[2 * xs[x]];
+        v[x] = uv[2 * xs[x] + 1];
+      }
+    }
+    return;
+  }
+
+  thread_local std::vector<uint8_t> u_rows, v_rows;
+  for (int factor : {2, 4}) {
+    if (filter == ScaleFilter::Box && src_uv_width == dst_uv_width * factor && src_uv_height == dst_uv_height * factor) {
+      // deinterleave just the rows of one output row at a time
+      u_rows.resize(factor * src_uv_width);
+      v_rows.resize(factor * src_uv_width);
+      const auto box_row = factor == 2 ? kernels().box2_row : kernels().box4_row;
+      for (int y = 0; y < dst_uv_height; ++y) {
+        for (int r = 0; r < factor; ++r) {
+          deinterleave_row(src_uv + (y * factor + r) * src_stride_uv,
+                           u_rows.data() + r * src_uv_width, v_rows.data() + r * src_uv_width, src_uv_width);
+        }
+        box_row(u_rows.data(), src_uv_width, dst_u + y * dst_stride_u, dst_uv_width);
+        box_row(v_rows.data(), src_uv_width, dst_v + y * dst_stride_v, dst_uv_width);
+      }
+      return;
+    }
+  }
+
+  // general case, deinterleave the whole chroma plane first
+  u_rows.resize(src_uv_width * src_uv_height);
+  v_rows.resize(src_uv_width * src_uv_height);
+  for (int y = 0; y < src_uv_height; ++y) {
+    deinterleave_row(src_uv + y * src_stride_uv, u_rows.data() + y * src_uv_width, v_rows.data() + y * src_uv_width, src_uv_width);
+  }
+  scale_plane(u_rows.data(), src_uv_width, src_uv_width, src_uv_height,
+              dst_u, dst_stride_u, dst_uv_width, dst_uv_height, filter);
+  scale_plane(v_rows.data(), src_uv_width, src_uv_width, src_uv_height,
+              dst_v, dst_stride_v, dst_uv_width, dst_uv_height, filter);
+}
+
+void nv12_scale(const uint8_t *src_y, int src_stride_y,
+                const uint8_t *src_uv, int src_stride_uv,
+                int src_width, int src_height,
+                uint8_t *dst_y, int dst_stride_y,
+                uint8_t *dst_uv, int dst_stride_uv,
                 int dst_width, int dst_height) {
-  scale_plane_point(src_y, src_stride_y, src_width, src_height,
-                    dst_y, dst_stride_y, dst_width, dst_height);
-  scale_plane_point(src_u, src_stride_u, src_width / 2, src_height / 2,
-                    dst_u, dst_stride_u, dst_width / 2, dst_height / 2);
-  scale_plane_point(src_v, src_stride_v, src_width / 2, src_height / 2,
-                    dst_v, dst_stride_v, dst_width / 2, dst_height / 2);
+  scale_plane(src_y, src_stride_y, src_width, src_height,
+              dst_y, dst_stride_y, dst_width, dst_height, ScaleFilter::Point);
+
+  // treat each UV pair as one 16 bit sample
+  const int src_uv_width = src_width / 2, src_uv_height = src_height / 2;
+  const int dst_uv_width = dst_width / 2, dst_uv_height = dst_height / 2;
+  const std::vector<int> &xs = point_table(src_uv_width, dst_uv_width);
+  for (int y = 0; y < dst_uv_height; ++y) {
+    const int sy = static_cast<int>(static_cast<int64_t>(y) * src_uv_height / dst_uv_height);
+    const uint8_t *src_row = src_uv + sy * src_stride_uv;
+    uint8_t *dst_row = dst_uv + y * dst_stride_uv;
+    for (int x = 0; x < dst_uv_width; ++x) {
+      std::memcpy(dst_row + 2 * x, src_row + 2 * xs[x], 2);
+    }
+  }
 }
 
 void nv12_to_rgba(const uint8_t *src_y, int src_stride_y,
                   const uint8_t *src_uv, int src_stride_uv,
                   uint8_t *dst_rgba, int dst_stride_rgba,
                   int width, int height) {
+  const auto nv12_rgba_row = kernels().nv12_rgba_row;
   for (int y = 0; y < height; ++y) {
-    const uint8_t *y_row = src_y + y * src_stride_y;
-    const uint8_t *uv_row = src_uv + (y / 2) * src_stride_uv;
-    uint8_t *dst = dst_rgba + y * dst_stride_rgba;
-    for (int x = 0; x < width; ++x) {
-      const int uv_x = (x & ~1);
-      uint8_t r, g, b;
-      yuv_to_rgb(y_row[x], uv_row[uv_x], uv_row[uv_x + 1], &r, &g, &b);
-      dst[4 * x + 0] = r;
-      dst[4 * x + 1] = g;
-      dst[4 * x + 2] = b;
-      dst[4 * x + 3] = 255;
-    }
+    nv12_rgba_row(src_y + y * src_stride_y, src_uv + (y / 2) * src_stride_uv, dst_rgba + y * dst_stride_rgba, width);
   }
 }
 
@@ -6,6 +6,20 @@
 
 namespace yuv {
 
+// Kernels are picked at runtime from the best instruction set the CPU supports.
+// The scalar kernels are the reference the SIMD ones must match bit for bit.
+enum class Isa { Scalar, SSE2, AVX2, NEON };
+
+Isa active_isa();
+// Force a kernel set, e.g. to compare against the scalar reference. Returns false if unsupported.
+bool set_isa(Isa isa);
+
+enum class ScaleFilter {
+  Point,     // nearest sample (libyuv kFilterNone)
+  Bilinear,  // 2x2 interpolation, pixel centers aligned
+  Box,       // average of the covered source area, best for large downscales
+};
+
 // Deinterleave NV12 UV into planar I420.
 void nv12_to_i420(const uint8_t *src_y, int src_stride_y,
                   const uint8_t *src_uv, int src_stride_uv,
@@ -22,7 +36,7 @@ void i420_to_nv12(const uint8_t *src_y, int src_stride_y,
                   uint8_t *dst_uv, int dst_stride_uv,
                   int width, int height);
 
-// Point-sample scale I420 (equivalent to libyuv::I420Scale + kFilterNone).
+// Scale I420. ScaleFilter::Point is equivalent to libyuv::I420Scale + kFilterNone.
 void i420_scale(const uint8_t *src_y, int src_stride_y,
                 const uint8_t *src_u, int src_stride_u,
                 const uint8_t *src_v, int src_stride_v,
@@ -30,6 +44,31 @@ void i420_scale(const uint8_t *src_y, int src_stride_y,
                 uint8_t *dst_y, int dst_stride_y,
                 uint8_t *dst_u, int dst_stride_u,
                 uint8_t *dst_v, int dst_stride_v,
+                int dst_width, int dst_height,
+                ScaleFilter filter = ScaleFilter::Point);
+
+// Scale a single 8-bit plane.
+void scale_plane(const uint8_t *src, int src_stride, int src_width, int src_height,
+                 uint8_t *dst, int dst_stride, int dst_width, int dst_height,
+                 ScaleFilter filter = ScaleFilter::Point);
+
+// Scale NV12 straight into I420. Same output as nv12_to_i420 followed by i420_scale, without
+// the full size intermediate for Point and for 2x/4x Box.
+void nv12_scale_to_i420(const uint8_t *src_y, int src_stride_y,
+                        const uint8_t *src_uv, int src_stride_uv,
+                        int src_width, int src_height,
+                        uint8_t *dst_y, int dst_stride_y,
+                        uint8_t *dst_u, int dst_stride_u,
+                        uint8_t *dst_v, int dst_stride_v,
+                        int dst_width, int dst_height,
+                        ScaleFilter filter = ScaleFilter::Point);
+
+// Point-sample scale NV12 to NV12 in one pass.
+void nv12_scale(const uint8_t *src_y, int src_stride_y,
+                const uint8_t *src_uv, int src_stride_uv,
+                int src_width, int src_height,
+                uint8_t *dst_y, int dst_stride_y,
+                uint8_t *dst_uv, int dst_stride_uv,
                 int dst_width, int dst_height);
 
 // Convert NV12 to packed RGBA (R,G,B,A bytes — suitable for GL_RGBA).
@@ -101,7 +101,7 @@ void can_recv(Panda *panda, PubMaster *pm) {
       canData[i].setDat(kj::arrayPtr((uint8_t*)raw_can_data[i].dat.data(), raw_can_data[i].dat.size()));
       canData[i].setSrc(raw_can_data[i].src);
     }
-    pm->send("can", msg);
+    pm->send(cereal::Event::CAN, msg);
   }
 }
 
@@ -279,6 +279,8 @@ void process_panda_state(Panda *panda, PubMaster *pm, bool engaged, bool is_onro
 void process_peripheral_state(Panda *panda, PubMaster *pm, bool no_fan_control, bool is_onroad) {
   static Params params;
   static SubMaster sm({"deviceState", "cabinCameraState"});
+  static const SubMaster::Handle device_state = sm.handle("deviceState");
+  static const SubMaster::Handle cabin_camera_state = sm.handle("cabinCameraState");
 
   static uint64_t last_cabin_camera_t = 0;
   static uint16_t prev_fan_speed = 999;
@@ -295,17 +297,17 @@ void process_peripheral_state(Panda *panda, PubMaster *pm, bool no_fan_control,
 
   {
     sm.update(0);
-    if (sm.updated("deviceState") && !no_fan_control) {
+    if (sm.updated(device_state) && !no_fan_control) {
       // Fan speed
-      uint16_t fan_speed = sm["deviceState"].getDeviceState().getFanSpeedPercentDesired();
+      uint16_t fan_speed = sm[device_state].getDeviceState().getFanSpeedPercentDesired();
       if (fan_speed != prev_fan_speed || sm.frame % 100 == 0) {
         panda->set_fan_speed(fan_speed);
         prev_fan_speed = fan_speed;
       }
     }
 
-    if (sm.updated("cabinCameraState")) {
-      auto event = sm["cabinCameraState"];
+    if (sm.updated(cabin_camera_state)) {
+      auto event = sm[cabin_camera_state];
       int cur_integ_lines = event.getCabinCameraState().getIntegLines();
 
       // reset the filter when camerad restarts
@@ -367,6 +369,8 @@ void pandad_run(Panda *panda) {
 
   RateKeeper rk("pandad", 100);
   SubMaster sm({"selfdriveState", "deviceState"});
+  const SubMaster::Handle selfdrive_state = sm.handle("selfdriveState");
+  const SubMaster::Handle device_state = sm.handle("deviceState");
   PubMaster pm({"can", "pandaStates", "peripheralState"});
   PandaSafety panda_safety(panda);
   bool engaged = false;
@@ -384,9 +388,9 @@ void pandad_run(Panda *panda) {
     // Process panda state at 10 Hz
     if (rk.frame() % 10 == 0) {
       sm.update(0);
-      engaged = sm.allAliveAndValid({"selfdriveState"}) && sm["selfdriveState"].getSelfdriveState().getEnabled();
-      if (sm.updated("deviceState")) {
-        is_onroad = sm["deviceState"].getDeviceState().getStarted();
+      engaged = sm.allAliveAndValid({"selfdriveState"}) && sm[selfdrive_state].getSelfdriveState().getEnabled();
+      if (sm.updated(device_state)) {
+        is_onroad = sm[device_state].getDeviceState().getStarted();
       }
       process_panda_state(panda, &pm, engaged, is_onroad, spoofing_started);
       panda_safety.configureSafetyMode(is_onroad);
@@ -4,29 +4,26 @@
 #include <string>
 
 #include "common/swaglog.h"
-#include "system/camerad/cameras/spectra.h"
 
 
-void CameraBuf::init(SpectraCamera *cam, VisionIpcServer * v, int frame_cnt, VisionStreamType type) {
+void CameraBuf::init(VisionIpcServer *v, int frame_cnt, VisionStreamType type, size_t raw_frame_size,
+                     size_t yuv_size, size_t stride, size_t uv_offset) {
   vipc_server = v;
   stream_type = type;
   frame_buf_count = frame_cnt;
 
-  const SensorInfo *sensor = cam->sensor.get();
-
   // RAW frames from ISP
-  if (cam->cc.output_type != ISP_IFE_PROCESSED) {
+  if (raw_frame_size > 0) {
     camera_bufs_raw = std::make_unique<VisionBuf[]>(frame_buf_count);
 
-    const int raw_frame_size = (sensor->frame_height + sensor->extra_height) * sensor->frame_stride;
     for (int i = 0; i < frame_buf_count; i++) {
       camera_bufs_raw[i].allocate(raw_frame_size);
     }
     LOGD("allocated %d buffers", frame_buf_count);
   }
 
-  vipc_server->create_buffers_with_sizes(stream_type, VIPC_BUFFER_COUNT, out_img_width, out_img_height, cam->yuv_size, cam->stride, cam->uv_offset);
-  LOGD("created %d YUV vipc buffers with size %dx%d", VIPC_BUFFER_COUNT, cam->stride, cam->y_height);
+  vipc_server->create_buffers_with_sizes(stream_type, VIPC_BUFFER_COUNT, out_img_width, out_img_height, yuv_size, stride, uv_offset);
+  LOGD("created %d YUV vipc buffers with size %zux%zu", VIPC_BUFFER_COUNT, stride, uv_offset / stride);
 }
 
 CameraBuf::~CameraBuf() {
@@ -69,30 +66,7 @@ kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b) {
 }
 
 float calculate_exposure_value(const CameraBuf *b, Rect ae_xywh, int x_skip, int y_skip) {
-  int lum_med;
-  uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
-
-  unsigned int lum_total = 0;
-  for (int y = ae_xywh.y; y < ae_xywh.y + ae_xywh.h; y += y_skip) {
-    for (int x = ae_xywh.x; x < ae_xywh.x + ae_xywh.w; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->out_img_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
-  }
-
-  // Find mean lumimance value
-  unsigned int lum_cur = 0;
-  for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
-
-    if (lum_cur >= lum_total / 2) {
-      break;
-    }
-  }
-
-  return lum_med / 256.0;
+  return calculate_exposure_value(b->cur_yuv_buf->y, b->cur_yuv_buf->stride, ae_xywh, x_skip, y_skip);
 }
 
 int open_v4l_by_name_and_index(const char name[], int index, int flags) {
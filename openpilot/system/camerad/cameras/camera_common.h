@@ -5,6 +5,7 @@
 #include "openpilot/cereal/messaging/messaging.h"
 #include "msgq/visionipc/visionipc_server.h"
 #include "common/util.h"
+#include "system/camerad/cameras/exposure.h"
 
 
 const int VIPC_BUFFER_COUNT = 18;
@@ -17,8 +18,6 @@ typedef struct FrameMetadata {
   float processing_time;
 } FrameMetadata;
 
-class SpectraCamera;
-
 class CameraBuf {
 private:
   int frame_buf_count;
@@ -36,7 +35,9 @@ public:
 
   CameraBuf() = default;
   ~CameraBuf();
-  void init(SpectraCamera *cam, VisionIpcServer * v, int frame_cnt, VisionStreamType type);
+  // raw_frame_size is 0 when the ISP only outputs processed frames
+  void init(VisionIpcServer *v, int frame_cnt, VisionStreamType type, size_t raw_frame_size,
+            size_t yuv_size, size_t stride, size_t uv_offset);
   void sendFrameToVipc();
 };
 
@@ -10,6 +10,7 @@
 #include <cmath>
 #include <cstring>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "common/params.h"
@@ -34,7 +35,6 @@ public:
   float analog_gain_frac = 0;
 
   float cur_ev[3] = {};
-  float best_ev_score = 0;
   int new_exp_g = 0;
   int new_exp_t = 0;
 
@@ -48,7 +48,6 @@ public:
   CameraState(SpectraMaster *master, const CameraConfig &config) : camera(master, config) {};
   ~CameraState();
   void init(VisionIpcServer *v);
-  void update_exposure_score(float desired_ev, int exp_t, int exp_g_idx, float exp_gain);
   void set_camera_exposure(float grey_frac);
   void set_exposure_rect();
   void sendState();
@@ -104,15 +103,6 @@ void CameraState::set_exposure_rect() {
   };
 }
 
-void CameraState::update_exposure_score(float desired_ev, int exp_t, int exp_g_idx, float exp_gain) {
-  float score = camera.sensor->getExposureScore(desired_ev, exp_t, exp_g_idx, exp_gain, gain_idx);
-  if (score < best_ev_score) {
-    new_exp_t = exp_t;
-    new_exp_g = exp_g_idx;
-    best_ev_score = score;
-  }
-}
-
 void CameraState::set_camera_exposure(float grey_frac) {
   if (!camera.enabled) return;
   std::vector<double> target_grey_minimums = {0.1, 0.1, 0.125}; // wide, road, driver
@@ -142,10 +132,6 @@ void CameraState::set_camera_exposure(float grey_frac) {
   float k = (1.0 - k_ev) / 3.0;
   desired_ev = (k * cur_ev[0]) + (k * cur_ev[1]) + (k * cur_ev[2]) + (k_ev * desired_ev);
 
-  best_ev_score = 1e6;
-  new_exp_g = 0;
-  new_exp_t = 0;
-
   // Hysteresis around high conversion gain
   // We usually want this on since it results in lower noise, but turn off in very bright day scenes
   bool enable_dc_gain = dc_gain_enabled;
@@ -176,22 +162,10 @@ void CameraState::set_camera_exposure(float grey_frac) {
     new_exp_t = exposure_time;
     enable_dc_gain = false;
   } else {
-    // Simple brute force optimizer to choose sensor parameters to reach desired EV
+    // only step the gain by one per frame
     int min_g = std::max(gain_idx - 1, sensor->analog_gain_min_idx);
     int max_g = std::min(gain_idx + 1, sensor->analog_gain_max_idx);
-    for (int g = min_g; g <= max_g; g++) {
-      float gain = sensor->sensor_analog_gains[g] * get_gain_factor();
-
-      // Compute optimal time for given gain
-      int t = std::clamp(int(std::round(desired_ev / gain)), sensor->exposure_time_min, sensor->exposure_time_max);
-
-      // Only go below recommended gain when absolutely necessary to not overexpose
-      if (g < sensor->analog_gain_rec_idx && t > 20 && g < gain_idx) {
-        continue;
-      }
-
-      update_exposure_score(desired_ev, t, g, gain);
-    }
+    std::tie(new_exp_t, new_exp_g) = sensor->findExposure(desired_ev, gain_idx, get_gain_factor(), min_g, max_g);
   }
 
   measured_grey_fraction = grey_frac;
@@ -0,0 +1,78 @@
+#include "system/camerad/cameras/exposure.h"
+
+#include <cstring>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "tile loads assume little endian");
+
+namespace {
+
+// consecutive samples go to separate histograms, so runs of equal pixels (flat sky, dark
+// interiors) don't serialize on a store-to-load dependency through the same bin
+constexpr int PARTIALS = 4;
+typedef uint32_t Histograms[PARTIALS][256];
+
+// loads the row in 16 byte tiles and picks the samples out with shifts
+template <int SKIP>
+void accumulate_row(const uint8_t *row, int width, Histograms &hist) {
+  constexpr int TILE = 16;
+  int x = 0;
+  for (; x + TILE <= width; x += TILE) {
+    uint64_t words[2];
+    memcpy(words, row + x, TILE);
+    for (int k = 0; k < TILE / SKIP; ++k) {
+      const int byte = k * SKIP;
+      hist[k % PARTIALS][(words[byte / 8] >> (8 * (byte % 8))) & 0xff]++;
+    }
+  }
+  for (int k = 0; x < width; x += SKIP, ++k) {
+    hist[k % PARTIALS][row[x]]++;
+  }
+}
+
+void accumulate_row(const uint8_t *row, int width, int skip, Histograms &hist) {
+  int x = 0;
+  for (; x + (PARTIALS - 1) * skip < width; x += PARTIALS * skip) {
+    hist[0][row[x]]++;
+    hist[1][row[x + skip]]++;
+    hist[2][row[x + 2 * skip]]++;
+    hist[3][row[x + 3 * skip]]++;
+  }
+  for (; x < width; x += skip) {
+    hist[0][row[x]]++;
+  }
+}
+
+}  // namespace
+
+float calculate_exposure_value(const uint8_t *plane, int stride, Rect ae_xywh, int x_skip, int y_skip) {
+  Histograms hist = {};
+  for (int y = ae_xywh.y; y < ae_xywh.y + ae_xywh.h; y += y_skip) {
+    const uint8_t *row = plane + (size_t)y * stride + ae_xywh.x;
+    switch (x_skip) {
+      case 1: accumulate_row<1>(row, ae_xywh.w, hist); break;
+      case 2: accumulate_row<2>(row, ae_xywh.w, hist); break;
+      case 4: accumulate_row<4>(row, ae_xywh.w, hist); break;
+      default: accumulate_row(row, ae_xywh.w, x_skip, hist); break;
+    }
+  }
+
+  uint32_t lum_binning[256];
+  unsigned int lum_total = 0;
+  for (int i = 0; i < 256; ++i) {
+    lum_binning[i] = hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+    lum_total += lum_binning[i];
+  }
+
+  // Find median luminance value
+  int lum_med;
+  unsigned int lum_cur = 0;
+  for (lum_med = 255; lum_med >= 0; lum_med--) {
+    lum_cur += lum_binning[lum_med];
+
+    if (lum_cur >= lum_total / 2) {
+      break;
+    }
+  }
+
+  return lum_med / 256.0;
+}
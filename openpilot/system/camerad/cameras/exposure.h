@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/util.h"
+
+// Median luminance of the Y plane inside ae_xywh, sampling every x_skip-th pixel of every
+// y_skip-th row. Returns [0, 1). Plain pointer and stride so it runs on synthetic frames.
+float calculate_exposure_value(const uint8_t *plane, int stride, Rect ae_xywh, int x_skip, int y_skip);
@@ -295,7 +295,8 @@ void SpectraCamera::camera_open(VisionIpcServer *v) {
   linkDevices();
 
   LOGD("camera init %d", cc.camera_num);
-  buf.init(this, v, ife_buf_depth, cc.stream_type);
+  const size_t raw_frame_size = cc.output_type != ISP_IFE_PROCESSED ? (sensor->frame_height + sensor->extra_height) * sensor->frame_stride : 0;
+  buf.init(v, ife_buf_depth, cc.stream_type, raw_frame_size, yuv_size, stride, uv_offset);
   camera_map_bufs();
   clearAndRequeue(1);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <map>
 #include <utility>
@@ -22,6 +24,31 @@ public:
   virtual float getExposureScore(float desired_ev, int exp_t, int exp_g_idx, float exp_gain, int gain_idx) const {return 0; }
   virtual int getSlaveAddress(int port) const { assert(0); }
 
+  // Simple brute force optimizer to choose sensor parameters to reach desired EV, trying the analog gains
+  // in [min_g, max_g]. returns the exposure time and gain index, {0, 0} if every gain was skipped
+  std::pair<int, int> findExposure(float desired_ev, int gain_idx, float gain_factor, int min_g, int max_g) const {
+    float best_score = 1e6;
+    std::pair<int, int> best = {0, 0};
+    for (int g = min_g; g <= max_g; g++) {
+      float gain = sensor_analog_gains[g] * gain_factor;
+
+      // Compute optimal time for given gain
+      int t = std::clamp(int(std::round(desired_ev / gain)), exposure_time_min, exposure_time_max);
+
+      // Only go below recommended gain when absolutely necessary to not overexpose
+      if (g < analog_gain_rec_idx && t > 20 && g < gain_idx) {
+        continue;
+      }
+
+      float score = getExposureScore(desired_ev, t, g, gain, gain_idx);
+      if (score < best_score) {
+        best = {t, g};
+        best_score = score;
+      }
+    }
+    return best;
+  }
+
   cereal::FrameData::ImageSensor image_sensor = cereal::FrameData::ImageSensor::UNKNOWN;
   float pixel_size_mm;
   uint32_t frame_width, frame_height;
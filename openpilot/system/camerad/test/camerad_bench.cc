@@ -0,0 +1,148 @@
+// Times camerad's CPU side per frame work on synthetic frames, no camera hardware needed:
+// the VIPC hand-off, raw frame copy, AE histogram and, on device, the sensor exposure search.
+//
+// usage: camerad_bench [frames]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "common/timing.h"
+#include "system/camerad/cameras/camera_common.h"
+#include "system/camerad/cameras/nv12_info.h"
+
+#ifdef __COMMA_HARDWARE__
+#include <memory>
+
+#include "system/camerad/sensors/sensor.h"
+#endif
+
+namespace {
+
+struct SyntheticSensor {
+  cereal::FrameData::ImageSensor image_sensor;
+  const char *name;
+  VisionStreamType stream_type;
+  int frame_width, frame_height, frame_stride, extra_height, out_scale;
+  Rect ae_xywh;
+  int y_skip;
+};
+
+// geometry from sensors/ox03c10.cc and sensors/os04c10.cc, AE rects as set_exposure_rect computes them
+// for the road and driver cameras
+const SyntheticSensor SENSORS[] = {
+  {cereal::FrameData::ImageSensor::OX03C10, "OX03C10", VISION_STREAM_NARROW_ROAD, 1928, 1208, 1928 * 12 / 8 + 4, 16, 1, {91, 157, 1746, 992}, 2},
+  {cereal::FrameData::ImageSensor::OS04C10, "OS04C10", VISION_STREAM_CABIN, 2688, 1520, 2688 * 12 / 8, 0, 2, {18, 108, 1308, 652}, 4},
+};
+
+class StageTimer {
+public:
+  void time(const std::string &stage, const std::function<void()> &f) {
+    const double t = nanos_since_boot();
+    f();
+    samples[stage].push_back((nanos_since_boot() - t) / 1e3);
+  }
+
+  void report(const char *name) {
+    printf("%s\n  %-24s %9s %9s %9s %9s %9s\n", name, "stage (us)", "min", "p50", "p90", "p99", "max");
+    for (auto &[stage, v] : samples) {
+      std::sort(v.begin(), v.end());
+      auto pct = [&v](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))]; };
+      printf("  %-24s %9.1f %9.1f %9.1f %9.1f %9.1f\n", stage.c_str(), v.front(), pct(0.5), pct(0.9), pct(0.99), v.back());
+    }
+  }
+
+private:
+  std::map<std::string, std::vector<double>> samples;
+};
+
+// smooth gradient plus noise, so the histogram sees a spread of values rather than one bin
+void fill_frame(VisionBuf *buf, std::mt19937 &rng, int shade) {
+  std::uniform_int_distribution<int> noise(-8, 8);
+  for (size_t y = 0; y < buf->height; ++y) {
+    uint8_t *row = buf->y + y * buf->stride;
+    for (size_t x = 0; x < buf->width; ++x) {
+      row[x] = std::clamp<int>(shade + (x * 128 / buf->width) + (y * 64 / buf->height) + noise(rng), 0, 255);
+    }
+  }
+  std::fill(buf->uv, buf->uv + buf->stride * buf->height / 2, 128);
+}
+
+#ifdef __COMMA_HARDWARE__
+// the search CameraState::set_camera_exposure runs every frame, swept over the full gain range
+size_t exposure_search(const SensorInfo *sensor, float desired_ev, int gain_idx) {
+  auto [t, g] = sensor->findExposure(desired_ev, gain_idx, sensor->dc_gain_factor, sensor->analog_gain_min_idx, sensor->analog_gain_max_idx);
+  return sensor->getExposureRegisters(t, g, true).size();
+}
+
+std::unique_ptr<SensorInfo> make_sensor(const SyntheticSensor &s) {
+  if (s.image_sensor == cereal::FrameData::ImageSensor::OX03C10) return std::make_unique<OX03C10>();
+  return std::make_unique<OS04C10>();
+}
+#endif
+
+// false if the pipeline produced nonsense, so a short run doubles as a smoke test
+bool run(VisionIpcServer &vipc, const SyntheticSensor &s, int frames) {
+  const int frame_buf_count = 4;
+  CameraBuf buf;
+  buf.out_img_width = s.frame_width / s.out_scale;
+  buf.out_img_height = s.frame_height / s.out_scale;
+  auto [stride, y_height, uv_height, yuv_size] = get_nv12_info(buf.out_img_width, buf.out_img_height);
+  buf.init(&vipc, frame_buf_count, s.stream_type, (s.frame_height + s.extra_height) * s.frame_stride,
+           yuv_size, stride, stride * y_height);
+
+  std::mt19937 rng(s.frame_width);
+  for (int i = 0; i < VIPC_BUFFER_COUNT; ++i) {
+    fill_frame(vipc.get_buffer(s.stream_type, i), rng, 16 + 4 * i);
+  }
+  for (int i = 0; i < frame_buf_count; ++i) {
+    std::fill((uint8_t *)buf.camera_bufs_raw[i].addr, (uint8_t *)buf.camera_bufs_raw[i].addr + buf.camera_bufs_raw[i].len, i);
+  }
+
+#ifdef __COMMA_HARDWARE__
+  auto sensor = make_sensor(s);
+  volatile size_t regs = 0;
+#endif
+
+  StageTimer timer;
+  volatile float ev = 0;
+  for (int frame_id = 0; frame_id < frames; ++frame_id) {
+    buf.cur_buf_idx = frame_id % frame_buf_count;
+    buf.cur_frame_data = {.frame_id = (uint32_t)frame_id, .request_id = (uint32_t)frame_id,
+                          .timestamp_sof = nanos_since_boot(), .timestamp_eof = nanos_since_boot()};
+
+    timer.time("sendFrameToVipc", [&] { buf.sendFrameToVipc(); });
+    timer.time("get_raw_frame_image", [&] { auto image = get_raw_frame_image(&buf); });
+    timer.time("calculate_exposure_value", [&] { ev = calculate_exposure_value(&buf, s.ae_xywh, 2, s.y_skip); });
+#ifdef __COMMA_HARDWARE__
+    timer.time("exposure_search", [&] { regs = exposure_search(sensor.get(), sensor->min_ev + ev * sensor->max_ev, sensor->analog_gain_rec_idx); });
+#endif
+  }
+
+  timer.report(util::string_format("%s %dx%d, %d frames", s.name, buf.out_img_width, buf.out_img_height, frames).c_str());
+  // the synthetic frames are mid grey on average
+  if (frames > 0 && (ev <= 0 || ev >= 1)) {
+    printf("%s: unexpected exposure value %.3f\n", s.name, (float)ev);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+  VisionIpcServer vipc("camerad_bench");
+  bool ok = true;
+  for (const auto &s : SENSORS) {
+    ok &= run(vipc, s, frames);
+  }
+  return ok ? 0 : 1;
+}
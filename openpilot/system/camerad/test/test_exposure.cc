@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "system/camerad/cameras/exposure.h"
+
+// straightforward single histogram version the tiled one must agree with
+static float reference_exposure_value(const uint8_t *plane, int stride, Rect ae, int x_skip, int y_skip) {
+  uint32_t lum_binning[256] = {0};
+  unsigned int lum_total = 0;
+  for (int y = ae.y; y < ae.y + ae.h; y += y_skip) {
+    for (int x = ae.x; x < ae.x + ae.w; x += x_skip) {
+      lum_binning[plane[y * stride + x]]++;
+      lum_total += 1;
+    }
+  }
+  int lum_med;
+  unsigned int lum_cur = 0;
+  for (lum_med = 255; lum_med >= 0; lum_med--) {
+    lum_cur += lum_binning[lum_med];
+    if (lum_cur >= lum_total / 2) break;
+  }
+  return lum_med / 256.0;
+}
+
+void test_matches_reference() {
+  std::mt19937 rng(1234);
+  const int width = 1928, height = 1208, stride = 2048;
+  std::vector<uint8_t> plane(stride * height);
+
+  // uniform noise, and a dark frame with a few bright patches where most samples hit one bin
+  std::uniform_int_distribution<int> noise(0, 255);
+  for (auto &p : plane) p = noise(rng);
+  std::vector<uint8_t> dark(stride * height, 12);
+  for (int y = 100; y < 300; ++y) {
+    for (int x = 500; x < 1500; ++x) dark[y * stride + x] = 240;
+  }
+
+  for (const auto *frame : {&plane, &dark}) {
+    for (Rect ae : {Rect{96, 160, 1734, 986}, Rect{0, 0, width, height}, Rect{3, 5, 17, 9}, Rect{1, 1, 31, 2}}) {
+      for (int x_skip : {1, 2, 3, 4, 7}) {
+        for (int y_skip : {1, 2, 4}) {
+          CHECK(calculate_exposure_value(frame->data(), stride, ae, x_skip, y_skip) ==
+                reference_exposure_value(frame->data(), stride, ae, x_skip, y_skip));
+        }
+      }
+    }
+  }
+}
+
+void test_known_median() {
+  // left half black, right half white: half the samples are 255, so the median scan stops there
+  const int width = 64, height = 16;
+  std::vector<uint8_t> plane(width * height, 0);
+  for (int y = 0; y < height; ++y) {
+    for (int x = width / 2; x < width; ++x) plane[y * width + x] = 255;
+  }
+  CHECK(calculate_exposure_value(plane.data(), width, {0, 0, width, height}, 2, 2) == 255 / 256.f);
+
+  // a gray ramp in rows, median of 0..63 from the top
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) plane[y * width + x] = x;
+  }
+  CHECK(calculate_exposure_value(plane.data(), width, {0, 0, width, height}, 1, 1) == 32 / 256.f);
+}
+
+int main() {
+  return run_native_test([] {
+    test_matches_reference();
+    test_known_median();
+  });
+}
@@ -17,17 +17,23 @@
 #include "openpilot/cereal/messaging/messaging.h"
 #include "msgq/visionipc/visionipc.h"
 #include "common/queue.h"
+#include "system/loggerd/encoder/frame_preprocessor.h"
 #include "system/loggerd/loggerd.h"
 
 class VideoEncoder {
 public:
   VideoEncoder(const EncoderInfo &encoder_info, int in_width, int in_height);
   virtual ~VideoEncoder() {}
-  virtual int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) = 0;
+  // frame is the preprocessor reference for buf, when one is set
+  virtual int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra, const FramePreprocessor::Frame &frame = nullptr) = 0;
   virtual void encoder_open() = 0;
   virtual void encoder_close() = 0;
   virtual void set_bitrate(int bitrate) = 0;
   virtual void request_keyframe() = 0;
+  // share conversions with the other encoders of the stream. the caller runs begin() for every
+  // frame and passes the reference to encode_frame. encoders that take the VisionBuf as is can
+  // ignore it
+  virtual void set_preprocessor(FramePreprocessor *preprocessor) {}
 
   void publisher_publish(int segment_num, uint32_t idx, VisionIpcBufExtra &extra, unsigned int flags, kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat);
 
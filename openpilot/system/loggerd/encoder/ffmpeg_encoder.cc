@@ -6,6 +6,8 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <utility>
 
 #define __STDC_CONSTANT_MACROS
 
@@ -21,22 +23,55 @@ extern "C" {
 
 const int env_debug_encoder = (getenv("DEBUG_ENCODER") != NULL) ? atoi(getenv("DEBUG_ENCODER")) : 0;
 
+static bool codec_supports_pix_fmt(const AVCodec *codec, AVPixelFormat pix_fmt) {
+  const AVPixelFormat *pix_fmts = NULL;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+  avcodec_get_supported_config(NULL, codec, AV_CODEC_CONFIG_PIX_FORMAT, 0, (const void **)&pix_fmts, NULL);
+#else
+  pix_fmts = codec->pix_fmts;
+#endif
+  for (; pix_fmts && *pix_fmts != AV_PIX_FMT_NONE; pix_fmts++) {
+    if (*pix_fmts == pix_fmt) return true;
+  }
+  return false;
+}
+
+// the VisionBuf is recycled after encode_frame, so it can only be lent to codecs that are done with
+// the input when avcodec_send_frame returns. libx264 copies each picture into its own lookahead,
+// other encoders without delay encode it right away. frame threading would keep references too,
+// it's off as the context keeps the default thread_count of 1
+static bool codec_consumes_input(const AVCodec *codec) {
+  return strcmp(codec->name, "libx264") == 0 || !(codec->capabilities & AV_CODEC_CAP_DELAY);
+}
+
+// the VisionBuf outlives the encode call, libavcodec only needs a reference to hand around
+static void visionbuf_free(void *opaque, uint8_t *data) {}
+
 FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
     : VideoEncoder(encoder_info, in_width, in_height) {
+  auto codec_id = encoder_info.get_settings(in_width).encode_type == cereal::EncodeIndex::Type::QCAMERA_H264
+                      ? AV_CODEC_ID_H264
+                      : AV_CODEC_ID_FFVHUFF;
+  codec = avcodec_find_encoder(codec_id);
+  assert(codec);
+  nv12_input = codec_supports_pix_fmt(codec, AV_PIX_FMT_NV12);
+  zero_copy = codec_consumes_input(codec);
+  // libx264 can only change the bitrate of a running stream in ABR mode with VBV, not in its default
+  // CRF mode, so live streams start rate controlled
+  if (encoder_info.is_live) {
+    bitrate = encoder_info.get_settings(in_width).bitrate;
+  }
+
   frame = av_frame_alloc();
   assert(frame);
-  frame->format = AV_PIX_FMT_YUV420P;
+  frame->format = nv12_input ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
   frame->width = out_width;
   frame->height = out_height;
-  frame->linesize[0] = out_width;
-  frame->linesize[1] = out_width/2;
-  frame->linesize[2] = out_width/2;
-
-  convert_buf.resize(in_width * in_height * 3 / 2);
 
-  if (in_width != out_width || in_height != out_height) {
-    downscale_buf.resize(out_width * out_height * 3 / 2);
-  }
+  own_preprocessor = std::make_unique<FramePreprocessor>(in_width, in_height);
+  set_preprocessor(own_preprocessor.get());
+  LOGD("ffmpeg encoder %s: %s input%s%s", encoder_info.publish_name, nv12_input ? "nv12" : "i420",
+       (in_width != out_width || in_height != out_height) ? ", downscaled" : "", zero_copy ? ", zero copy" : "");
 }
 
 FfmpegEncoder::~FfmpegEncoder() {
@@ -44,20 +79,30 @@ FfmpegEncoder::~FfmpegEncoder() {
   av_frame_free(&frame);
 }
 
-void FfmpegEncoder::encoder_open() {
-  auto codec_id = encoder_info.get_settings(in_width).encode_type == cereal::EncodeIndex::Type::QCAMERA_H264
-                      ? AV_CODEC_ID_H264
-                      : AV_CODEC_ID_FFVHUFF;
-  const AVCodec *codec = avcodec_find_encoder(codec_id);
-
+void FfmpegEncoder::open_codec() {
   this->codec_ctx = avcodec_alloc_context3(codec);
   assert(this->codec_ctx);
   this->codec_ctx->width = frame->width;
   this->codec_ctx->height = frame->height;
-  this->codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  this->codec_ctx->pix_fmt = (AVPixelFormat)frame->format;
   this->codec_ctx->time_base = (AVRational){ 1, encoder_info.fps };
-  int err = avcodec_open2(this->codec_ctx, codec, NULL);
+  rate_controlled = bitrate > 0;
+  if (rate_controlled) {
+    this->codec_ctx->bit_rate = bitrate;
+    this->codec_ctx->rc_max_rate = bitrate;
+    this->codec_ctx->rc_buffer_size = bitrate;
+  }
+
+  // make forced keyframes IDRs, so a new livestream viewer can start decoding from them
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "forced-idr", "1", 0);
+  int err = avcodec_open2(this->codec_ctx, codec, &opts);
+  av_dict_free(&opts);
   assert(err >= 0);
+}
+
+void FfmpegEncoder::encoder_open() {
+  open_codec();
 
   is_open = true;
   segment_num++;
@@ -71,49 +116,60 @@ void FfmpegEncoder::encoder_close() {
   is_open = false;
 }
 
-void FfmpegEncoder::set_bitrate(int bitrate) {
-  LOGE("adaptive bitrate is not supported for ffmpeg encoder %s", encoder_info.publish_name);
+void FfmpegEncoder::set_bitrate(int new_bitrate) {
+  if (new_bitrate == bitrate) return;
+  if (new_bitrate <= 0) {
+    LOGE("invalid encoder bitrate %d for %s", new_bitrate, encoder_info.publish_name);
+    return;
+  }
+  bitrate = new_bitrate;
+  if (!is_open) return;
+
+  if (strcmp(codec->name, "libx264") == 0 && rate_controlled) {
+    // libx264 picks up rate control changes on the next frame
+    codec_ctx->bit_rate = bitrate;
+    codec_ctx->rc_max_rate = bitrate;
+    codec_ctx->rc_buffer_size = bitrate;
+  } else {
+    // everything else, and libx264 opened in CRF mode, needs a new context. frames already sent are
+    // dropped, the new stream starts with a keyframe
+    avcodec_free_context(&codec_ctx);
+    open_codec();
+  }
+  LOGD("%s bitrate set to %d", encoder_info.publish_name, bitrate);
 }
 
 void FfmpegEncoder::request_keyframe() {
-  LOGE("keyframe request is not supported for ffmpeg encoder %s", encoder_info.publish_name);
+  keyframe_requested = true;
+}
+
+void FfmpegEncoder::set_preprocessor(FramePreprocessor *pp) {
+  if (pp != own_preprocessor.get()) own_preprocessor.reset();
+  preprocessor = pp;
+  frame_handle = preprocessor->add(nv12_input ? FrameFormat::NV12 : FrameFormat::I420, out_width, out_height);
 }
 
-int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
+int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra, const FramePreprocessor::Frame &shared_frame) {
   assert(buf->width == this->in_width);
   assert(buf->height == this->in_height);
 
-  uint8_t *cy = convert_buf.data();
-  uint8_t *cu = cy + in_width * in_height;
-  uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
-  yuv::nv12_to_i420(buf->y, buf->stride,
-                    buf->uv, buf->stride,
-                    cy, in_width,
-                    cu, in_width/2,
-                    cv, in_width/2,
-                    in_width, in_height);
-
-  if (downscale_buf.size() > 0) {
-    uint8_t *out_y = downscale_buf.data();
-    uint8_t *out_u = out_y + frame->width * frame->height;
-    uint8_t *out_v = out_u + (frame->width / 2) * (frame->height / 2);
-    yuv::i420_scale(cy, in_width,
-                    cu, in_width/2,
-                    cv, in_width/2,
-                    in_width, in_height,
-                    out_y, frame->width,
-                    out_u, frame->width/2,
-                    out_v, frame->width/2,
-                    frame->width, frame->height);
-    frame->data[0] = out_y;
-    frame->data[1] = out_u;
-    frame->data[2] = out_v;
-  } else {
-    frame->data[0] = cy;
-    frame->data[1] = cu;
-    frame->data[2] = cv;
+  FramePreprocessor::Frame own_frame;
+  if (preprocessor == own_preprocessor.get()) {
+    own_frame = preprocessor->begin(buf);
+  }
+  assert(own_frame || shared_frame);
+  const PreparedFrame &pf = preprocessor->get(own_frame ? own_frame : shared_frame, frame_handle);
+  for (int i = 0; i < 3; ++i) {
+    frame->data[i] = pf.data[i];
+    frame->linesize[i] = pf.linesize[i];
+  }
+
+  // without a buffer ref libavcodec copies the whole frame when it takes its own reference
+  if (pf.borrowed && zero_copy) {
+    frame->buf[0] = av_buffer_create((uint8_t *)buf->addr, buf->len, visionbuf_free, NULL, AV_BUFFER_FLAG_READONLY);
   }
   frame->pts = counter*50*1000; // 50ms per frame
+  frame->pict_type = std::exchange(keyframe_requested, false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
 
   int ret = counter;
 
@@ -152,5 +208,7 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
     counter++;
   }
   av_packet_unref(&pkt);
+
+  av_buffer_unref(&frame->buf[0]);
   return ret;
 }
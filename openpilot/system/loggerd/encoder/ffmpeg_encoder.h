@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,19 +19,32 @@ class FfmpegEncoder : public VideoEncoder {
 public:
   FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height);
   ~FfmpegEncoder();
-  int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
+  int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra, const FramePreprocessor::Frame &frame = nullptr);
   void encoder_open();
   void encoder_close();
   void set_bitrate(int bitrate);
   void request_keyframe();
+  void set_preprocessor(FramePreprocessor *preprocessor);
 
 private:
+  void open_codec();
+
   int segment_num = -1;
   int counter = 0;
   bool is_open = false;
+  int bitrate = -1;  // -1 is the codec default
+  bool rate_controlled = false;  // the open context has a bitrate and VBV
+  bool keyframe_requested = false;
 
+  const AVCodec *codec = NULL;
   AVCodecContext *codec_ctx;
   AVFrame *frame = NULL;
-  std::vector<uint8_t> convert_buf;
-  std::vector<uint8_t> downscale_buf;
+  // feed NV12 straight from the VisionBuf when the codec takes it, skipping the I420 conversion
+  bool nv12_input = false;
+  // wrap VisionBuf memory in a refcounted AVFrame so libavcodec doesn't copy it again.
+  // only for codecs that don't hold on to input frames past encode_frame
+  bool zero_copy = false;
+  std::unique_ptr<FramePreprocessor> own_preprocessor;
+  FramePreprocessor *preprocessor = NULL;
+  int frame_handle = -1;
 };
@@ -0,0 +1,121 @@
+#include "system/loggerd/encoder/frame_preprocessor.h"
+
+#include <cassert>
+
+FramePreprocessor::FramePreprocessor(int in_width, int in_height) : in_width(in_width), in_height(in_height) {}
+
+int FramePreprocessor::add(FrameFormat format, int width, int height, yuv::ScaleFilter filter) {
+  // point sampling at full size is an exact copy, so the filter doesn't matter there
+  if (width == in_width && height == in_height) filter = yuv::ScaleFilter::Point;
+
+  for (int i = 0; i < infos.size(); ++i) {
+    const OutputInfo &info = infos[i];
+    if (info.format == format && info.width == width && info.height == height && info.filter == filter) {
+      return i;
+    }
+  }
+
+  // filtered NV12 output is scaled from planar input, sharing the full size I420 with any encoder that needs it
+  int source = -1;
+  if (format == FrameFormat::NV12 && filter != yuv::ScaleFilter::Point) {
+    source = add(FrameFormat::I420, in_width, in_height);
+  }
+  infos.push_back({format, width, height, filter, source});
+  return infos.size() - 1;
+}
+
+FramePreprocessor::Frame FramePreprocessor::begin(VisionBuf *buf) {
+  assert(buf->width == in_width && buf->height == in_height);
+
+  std::lock_guard lk(lock);
+  // reuse the oldest set nobody holds a reference to
+  Frame set;
+  for (auto &s : sets) {
+    if (s.use_count() == 1 && (!set || s->seq < set->seq)) set = s;
+  }
+  if (!set) {
+    set = sets.emplace_back(std::make_shared<FrameSet>());
+  }
+
+  set->buf = buf;
+  set->seq = ++cur_seq;
+  while (set->outputs.size() < infos.size()) set->outputs.emplace_back();
+  for (auto &out : set->outputs) out.ready = false;
+  return set;
+}
+
+const PreparedFrame &FramePreprocessor::get(const Frame &frame, int handle) {
+  return get(*frame, handle);
+}
+
+const PreparedFrame &FramePreprocessor::get(FrameSet &set, int handle) {
+  Output &out = set.outputs[handle];
+  std::lock_guard lk(out.lock);
+  if (!out.ready) {
+    convert(set, infos[handle], out);
+    out.ready = true;
+  }
+  return out.frame;
+}
+
+void FramePreprocessor::convert(FrameSet &set, const OutputInfo &info, Output &out) {
+  const VisionBuf *buf = set.buf;
+  PreparedFrame &f = out.frame;
+  f.format = info.format;
+  f.width = info.width;
+  f.height = info.height;
+
+  const bool full_size = f.width == in_width && f.height == in_height;
+  f.borrowed = full_size && f.format == FrameFormat::NV12;
+  if (f.borrowed) {
+    f.data[0] = buf->y;
+    f.data[1] = buf->uv;
+    f.linesize[0] = f.linesize[1] = buf->stride;
+    return;
+  }
+
+  if (out.buf.empty()) {
+    out.buf.resize(f.width * f.height * 3 / 2);
+    f.data[0] = out.buf.data();
+    f.data[1] = f.data[0] + f.width * f.height;
+    f.linesize[0] = f.width;
+    if (f.format == FrameFormat::NV12) {
+      f.linesize[1] = f.width;
+    } else {
+      f.data[2] = f.data[1] + (f.width / 2) * (f.height / 2);
+      f.linesize[1] = f.linesize[2] = f.width / 2;
+    }
+  }
+
+  if (full_size) {
+    yuv::nv12_to_i420(buf->y, buf->stride, buf->uv, buf->stride,
+                      f.data[0], f.linesize[0], f.data[1], f.linesize[1], f.data[2], f.linesize[2],
+                      f.width, f.height);
+  } else if (f.format == FrameFormat::I420) {
+    // scale and convert in one pass over the source
+    yuv::nv12_scale_to_i420(buf->y, buf->stride, buf->uv, buf->stride, in_width, in_height,
+                            f.data[0], f.linesize[0], f.data[1], f.linesize[1], f.data[2], f.linesize[2],
+                            f.width, f.height, info.filter);
+  } else if (info.filter == yuv::ScaleFilter::Point) {
+    yuv::nv12_scale(buf->y, buf->stride, buf->uv, buf->stride, in_width, in_height,
+                    f.data[0], f.linesize[0], f.data[1], f.linesize[1], f.width, f.height);
+  } else {
+    const PreparedFrame &src = get(set, info.source);
+    const int uv_width = f.width / 2, uv_height = f.height / 2;
+    out.scratch.resize(uv_width * uv_height * 2);
+    uint8_t *u = out.scratch.data(), *v = u + uv_width * uv_height;
+    yuv::scale_plane(src.data[0], src.linesize[0], in_width, in_height,
+                     f.data[0], f.linesize[0], f.width, f.height, info.filter);
+    yuv::scale_plane(src.data[1], src.linesize[1], in_width / 2, in_height / 2,
+                     u, uv_width, uv_width, uv_height, info.filter);
+    yuv::scale_plane(src.data[2], src.linesize[2], in_width / 2, in_height / 2,
+                     v, uv_width, uv_width, uv_height, info.filter);
+    for (int y = 0; y < uv_height; ++y) {
+      uint8_t *uv = f.data[1] + y * f.linesize[1];
+      for (int x = 0; x < uv_width; ++x) {
+        uv[2 * x] = u[y * uv_width + x];
+        uv[2 * x + 1] = v[y * uv_width + x];
+      }
+    }
+  }
+}
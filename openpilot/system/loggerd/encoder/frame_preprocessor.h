@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "msgq/visionipc/visionbuf.h"
+#include "common/yuv.h"
+
+enum class FrameFormat { NV12, I420 };
+
+// a converted/scaled picture ready for an encoder. planes may point into the source VisionBuf
+struct PreparedFrame {
+  FrameFormat format;
+  int width, height;
+  uint8_t *data[3] = {};
+  int linesize[3] = {};
+  bool borrowed = false;  // data points into the source VisionBuf
+};
+
+// per camera stream preprocessing shared by all encoders of that stream. every encoder registers
+// the picture it needs, identical requests share one output, and each output is computed at most
+// once per frame, on first use.
+//
+// encoders may run on their own threads and lag behind each other, so several frames can be in
+// flight. begin() returns a reference to the frame that keeps its outputs alive, get() on it is
+// thread safe.
+class FramePreprocessor {
+public:
+  struct FrameSet;
+  using Frame = std::shared_ptr<FrameSet>;
+
+  FramePreprocessor(int in_width, int in_height);
+
+  // returns a handle for get(). register all outputs before the first frame
+  int add(FrameFormat format, int width, int height, yuv::ScaleFilter filter = yuv::ScaleFilter::Point);
+  Frame begin(VisionBuf *buf);
+  const PreparedFrame &get(const Frame &frame, int handle);
+
+private:
+  struct OutputInfo {
+    FrameFormat format;
+    int width, height;
+    yuv::ScaleFilter filter;
+    int source;  // full size I420 output that filtered NV12 scaling reads from
+  };
+
+  struct Output {
+    std::mutex lock;
+    bool ready = false;
+    PreparedFrame frame;
+    std::vector<uint8_t> buf;
+    std::vector<uint8_t> scratch;
+  };
+
+  const PreparedFrame &get(FrameSet &set, int handle);
+  void convert(FrameSet &set, const OutputInfo &info, Output &out);
+
+  const int in_width, in_height;
+  std::vector<OutputInfo> infos;
+
+  std::mutex lock;
+  uint64_t cur_seq = 0;
+  std::vector<Frame> sets;
+};
+
+struct FramePreprocessor::FrameSet {
+  VisionBuf *buf = nullptr;
+  uint64_t seq = 0;
+  std::deque<Output> outputs;
+};
@@ -4,13 +4,14 @@
 #include <cstring>
 
 #include "common/swaglog.h"
+#include "common/util.h"
 
 // Lower qscale = higher quality / bigger files for MJPEG.
 constexpr int MJPEG_QSCALE = 7;
 
-JpegEncoder::JpegEncoder(const std::string &publish_name, int width, int height)
-    : publish_name(publish_name), thumbnail_width(width), thumbnail_height(height) {
-  yuv_buffer.resize((thumbnail_width * thumbnail_height * 3) / 2);
+JpegEncoder::JpegEncoder(const std::string &publish_name, int width, int height, FramePreprocessor *preprocessor)
+    : publish_name(publish_name), thumbnail_width(width), thumbnail_height(height), preprocessor(preprocessor) {
+  thumbnail_handle = preprocessor->add(FrameFormat::I420, thumbnail_width, thumbnail_height, yuv::ScaleFilter::Box);
   pm = std::make_unique<PubMaster>(std::vector{publish_name.c_str()});
 
   const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
@@ -34,63 +35,82 @@ JpegEncoder::JpegEncoder(const std::string &publish_name, int width, int height)
   frame->format = codec_ctx->pix_fmt;
   frame->width = thumbnail_width;
   frame->height = thumbnail_height;
-  frame->linesize[0] = thumbnail_width;
-  frame->linesize[1] = thumbnail_width / 2;
-  frame->linesize[2] = thumbnail_width / 2;
   frame->color_range = AVCOL_RANGE_JPEG;
 
   pkt = av_packet_alloc();
   assert(pkt);
+
+  worker = std::thread(&JpegEncoder::workerThread, this);
 }
 
 JpegEncoder::~JpegEncoder() {
+  {
+    std::lock_guard lk(lock);
+    exit = true;
+  }
+  cv.notify_one();
+  worker.join();
+
   av_packet_free(&pkt);
   av_frame_free(&frame);
   avcodec_free_context(&codec_ctx);
 }
 
-void JpegEncoder::pushThumbnail(VisionBuf *buf, const VisionIpcBufExtra &extra) {
-  generateThumbnail(buf->y, buf->uv, buf->width, buf->height, buf->stride);
+void JpegEncoder::pushThumbnail(VisionBuf *buf, const VisionIpcBufExtra &extra, FramePreprocessor::Frame frame_ref) {
+  {
+    std::lock_guard lk(lock);
+    if (pending) {
+      LOGW("%s: previous thumbnail still in progress, skipping frame %d", publish_name.c_str(), extra.frame_id);
+      return;
+    }
+    pending = Job{buf, extra, std::move(frame_ref)};
+  }
+  cv.notify_one();
+}
+
+void JpegEncoder::workerThread() {
+  util::set_thread_name("encoderd_jpeg");
+  if (util::set_background_priority() != 0) {
+    LOGD("failed to lower thumbnail thread priority");
+  }
+
+  while (true) {
+    std::unique_lock lk(lock);
+    cv.wait(lk, [this] { return exit || pending; });
+    if (exit) break;
+    Job job = std::move(*pending);
+    lk.unlock();
+
+    encodeThumbnail(job);
+
+    lk.lock();
+    pending.reset();
+  }
+}
+
+void JpegEncoder::encodeThumbnail(const Job &job) {
+  const PreparedFrame &thumbnail = preprocessor->get(job.frame, thumbnail_handle);
+  // camerad may have reused the buffer while we were waiting for the cpu
+  if (job.buf->get_frame_id() != job.extra.frame_id) {
+    LOGW("%s: buffer reused before thumbnail of frame %d was taken", publish_name.c_str(), job.extra.frame_id);
+    return;
+  }
+  compressToJpeg(thumbnail);
 
   MessageBuilder msg;
   auto thumbnaild = msg.initEvent().initThumbnail();
-  thumbnaild.setFrameId(extra.frame_id);
-  thumbnaild.setTimestampEof(extra.timestamp_eof);
+  thumbnaild.setFrameId(job.extra.frame_id);
+  thumbnaild.setTimestampEof(job.extra.timestamp_eof);
   thumbnaild.setThumbnail({out_buffer.data(), out_buffer.size()});
 
   pm->send(publish_name.c_str(), msg);
 }
 
-void JpegEncoder::generateThumbnail(const uint8_t *y_addr, const uint8_t *uv_addr, int width, int height, int stride) {
-  int downscale = width / thumbnail_width;
-  assert(downscale * thumbnail_height == height);
-
-  uint8_t *y_plane = yuv_buffer.data();
-  uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
-  uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
-  {
-    // subsampled conversion from nv12 to yuv420p
-    for (int hy = 0; hy < thumbnail_height / 2; hy++) {
-      for (int hx = 0; hx < thumbnail_width / 2; hx++) {
-        int ix = hx * downscale + (downscale - 1) / 2;
-        int iy = hy * downscale + (downscale - 1) / 2;
-        y_plane[(hy * 2 + 0) * thumbnail_width + (hx * 2 + 0)] = y_addr[(iy * 2 + 0) * stride + ix * 2 + 0];
-        y_plane[(hy * 2 + 0) * thumbnail_width + (hx * 2 + 1)] = y_addr[(iy * 2 + 0) * stride + ix * 2 + 1];
-        y_plane[(hy * 2 + 1) * thumbnail_width + (hx * 2 + 0)] = y_addr[(iy * 2 + 1) * stride + ix * 2 + 0];
-        y_plane[(hy * 2 + 1) * thumbnail_width + (hx * 2 + 1)] = y_addr[(iy * 2 + 1) * stride + ix * 2 + 1];
-        u_plane[hy * thumbnail_width / 2 + hx] = uv_addr[iy * stride + ix * 2 + 0];
-        v_plane[hy * thumbnail_width / 2 + hx] = uv_addr[iy * stride + ix * 2 + 1];
-      }
-    }
+void JpegEncoder::compressToJpeg(const PreparedFrame &thumbnail) {
+  for (int i = 0; i < 3; ++i) {
+    frame->data[i] = thumbnail.data[i];
+    frame->linesize[i] = thumbnail.linesize[i];
   }
-
-  compressToJpeg(y_plane, u_plane, v_plane);
-}
-
-void JpegEncoder::compressToJpeg(uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane) {
-  frame->data[0] = y_plane;
-  frame->data[1] = u_plane;
-  frame->data[2] = v_plane;
   // Required for MJPEG qscale to take effect (global_quality alone is not enough).
   frame->quality = FF_QP2LAMBDA * MJPEG_QSCALE;
   frame->pts = AV_NOPTS_VALUE;
@@ -1,35 +1,57 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "openpilot/cereal/messaging/messaging.h"
 #include "msgq/visionipc/visionbuf.h"
+#include "system/loggerd/encoder/frame_preprocessor.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// thumbnails are downscaled and compressed on a low priority worker, so they never hold up video encoding
 class JpegEncoder {
 public:
-  JpegEncoder(const std::string &publish_name, int width, int height);
+  // the thumbnail is taken from preprocessor
+  JpegEncoder(const std::string &publish_name, int width, int height, FramePreprocessor *preprocessor);
   ~JpegEncoder();
-  void pushThumbnail(VisionBuf *buf, const VisionIpcBufExtra &extra);
+  // frame is the preprocessor reference for buf. dropped if the previous thumbnail is still in progress
+  void pushThumbnail(VisionBuf *buf, const VisionIpcBufExtra &extra, FramePreprocessor::Frame frame);
 
 private:
-  void generateThumbnail(const uint8_t *y, const uint8_t *uv, int width, int height, int stride);
-  void compressToJpeg(uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane);
+  struct Job {
+    VisionBuf *buf;
+    VisionIpcBufExtra extra;
+    FramePreprocessor::Frame frame;
+  };
+
+  void workerThread();
+  void encodeThumbnail(const Job &job);
+  void compressToJpeg(const PreparedFrame &thumbnail);
 
   int thumbnail_width;
   int thumbnail_height;
   std::string publish_name;
-  std::vector<uint8_t> yuv_buffer;
   std::vector<uint8_t> out_buffer;
   std::unique_ptr<PubMaster> pm;
+  FramePreprocessor *preprocessor;
+  int thumbnail_handle;
 
   AVCodecContext *codec_ctx = nullptr;
   AVFrame *frame = nullptr;
   AVPacket *pkt = nullptr;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::optional<Job> pending;
+  bool exit = false;
+  std::thread worker;
 };
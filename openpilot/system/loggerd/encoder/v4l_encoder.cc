@@ -122,7 +122,8 @@ void V4LEncoder::dequeue_handler(V4LEncoder *e) {
         header = kj::heapArray<capnp::byte>(buf, bytesused);
         if (e->packet_callback) e->packet_callback(header.begin(), header.size(), ts, true, false);
       } else {
-        VisionIpcBufExtra extra = e->extras.pop();
+        VisionIpcBufExtra extra;
+        e->extras.pop(extra);
         assert(extra.timestamp_eof/1000 == ts); // stay in sync
         frame_id = extra.frame_id;
         ++idx;
@@ -311,14 +312,15 @@ void V4LEncoder::encoder_open() {
   this->counter = 0;
 }
 
-int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
+int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra, const FramePreprocessor::Frame &frame) {
   struct timeval timestamp {
     .tv_sec = (long)(extra->timestamp_eof/1000000000),
     .tv_usec = (long)((extra->timestamp_eof/1000) % 1000000),
   };
 
   // reserve buffer
-  int buffer_in = free_buf_in.pop();
+  unsigned int buffer_in;
+  free_buf_in.pop(buffer_in);
   input_bufs[buffer_in].store(buf);
 
   // push buffer
@@ -332,7 +334,8 @@ int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
 void V4LEncoder::encoder_close() {
   if (this->is_open) {
     // pop all the frames before closing, then put the buffers back
-    for (int i = 0; i < BUF_IN_COUNT; i++) free_buf_in.pop();
+    unsigned int index;
+    for (int i = 0; i < BUF_IN_COUNT; i++) free_buf_in.pop(index);
     for (int i = 0; i < BUF_IN_COUNT; i++) free_buf_in.push(i);
     // no frames, stop the encoder
     struct v4l2_encoder_cmd encoder_cmd = { .cmd = V4L2_ENC_CMD_STOP };
@@ -23,7 +23,7 @@ public:
   V4LEncoder(const EncoderInfo &encoder_info, int in_width, int in_height);
   V4LEncoder(const EncoderInfo &encoder_info, int in_width, int in_height, Options options);
   ~V4LEncoder();
-  int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
+  int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra, const FramePreprocessor::Frame &frame = nullptr);
   void encoder_open();
   void encoder_close();
   void set_bitrate(int bitrate);
@@ -36,7 +36,7 @@ private:
   int segment_num = -1;
   int counter = 0;
   int current_bitrate = -1;
-  SafeQueue<VisionIpcBufExtra> extras;
+  SPSCQueue<VisionIpcBufExtra> extras{BUF_IN_COUNT + BUF_OUT_COUNT};  // one per frame inside the encoder
   PacketCallback packet_callback;
   InputDoneCallback input_done_callback;
 
@@ -45,5 +45,5 @@ private:
 
   VisionBuf buf_out[BUF_OUT_COUNT];
   std::atomic<VisionBuf *> input_bufs[BUF_IN_COUNT] = {};
-  SafeQueue<unsigned int> free_buf_in;
+  SPSCQueue<unsigned int> free_buf_in{BUF_IN_COUNT};
 };
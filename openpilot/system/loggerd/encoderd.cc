@@ -1,4 +1,7 @@
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #ifdef __COMMA_HARDWARE__
 #include <exception>
 #include <stdexcept>
@@ -7,6 +10,7 @@
 #ifdef __COMMA_HARDWARE__
 #include "system/loggerd/clip_encoder.h"
 #endif
+#include "common/params_watcher.h"
 #include "system/loggerd/loggerd.h"
 #include "system/loggerd/encoder/jpeg_encoder.h"
 
@@ -20,8 +24,35 @@
 
 ExitHandler do_exit;
 
+// frames queued per encoder worker. VisionIPC buffers are only referenced, so this has to stay
+// well below the number of buffers camerad cycles through
+constexpr int ENCODER_QUEUE_SIZE = 3;
+
+// livestream controls set by webrtcd. the params are watched for changes, so the encoder loops
+// only look at the cached values
+class LivestreamControls {
+public:
+  int bitrate() const { return bitrate_.load(std::memory_order_relaxed); }
+  bool keyframe_requested() const { return keyframe_.load(std::memory_order_relaxed); }
+
+private:
+  void update(const std::string &key, const std::string &value) {
+    if (key == "LivestreamEncoderBitrate") {
+      bitrate_ = value.empty() ? 0 : std::atoi(value.c_str());
+    } else {
+      keyframe_ = value == "1";
+    }
+  }
+
+  std::atomic<int> bitrate_ = 0;
+  std::atomic<bool> keyframe_ = false;
+  ParamsWatcher watcher{{"LivestreamEncoderBitrate", "LivestreamRequestKeyframe"},
+                        [this](const std::string &key, const std::string &value) { update(key, value); }};
+};
+
 struct EncoderdState {
   int max_waiting = 0;
+  std::unique_ptr<LivestreamControls> live_controls;  // only when a camera has a live encoder
 
   // Sync logic for startup
   std::atomic<int> encoders_ready = 0;
@@ -51,28 +82,116 @@ bool sync_encoders(EncoderdState *s, VisionStreamType cam_type, uint32_t frame_i
   }
 }
 
-void encoder_set_bitrate(std::unique_ptr<Encoder> &e) {
-  static Params params;
-  std::string val = params.get("LivestreamEncoderBitrate");
-  if (val.empty()) return;
-  int bitrate = std::stoi(val);
-  e->set_bitrate(bitrate);
+void encoder_update_live(const LivestreamControls &controls, std::unique_ptr<Encoder> &e) {
+  if (int bitrate = controls.bitrate(); bitrate > 0) {
+    e->set_bitrate(bitrate);
+  }
+  if (controls.keyframe_requested()) {
+    e->request_keyframe();
+  }
 }
 
-void encoder_request_keyframe(std::unique_ptr<Encoder> &e) {
-  static Params params;
-  if (!params.getBool("LivestreamRequestKeyframe")) return;
-  e->request_keyframe();
-}
+struct EncodeJob {
+  VisionBuf *buf;
+  VisionIpcBufExtra extra;
+  FramePreprocessor::Frame frame;  // the shared preprocessing outputs of this frame
+  int segment;
+};
+
+// each encoder runs on its own thread, so a slow livestream or qcamera encode never delays the
+// recording. recording encoders apply backpressure when they fall behind, the others drop frames.
+class EncoderWorker {
+public:
+  EncoderWorker(const LogCameraInfo &cam_info, const EncoderInfo &encoder_info, int in_width, std::unique_ptr<Encoder> encoder,
+                const LivestreamControls *live_controls)
+      : cam_info(cam_info), encoder_info(encoder_info), encoder(std::move(encoder)), live_controls(live_controls) {
+    critical = !encoder_info.is_live &&
+               encoder_info.get_settings(in_width).encode_type != cereal::EncodeIndex::Type::QCAMERA_H264;
+    thread = std::thread(&EncoderWorker::run, this);
+  }
+
+  ~EncoderWorker() {
+    {
+      std::lock_guard lk(lock);
+      exit = true;
+    }
+    cv.notify_all();
+    thread.join();
+  }
+
+  void push(EncodeJob &&job) {
+    std::unique_lock lk(lock);
+    if (critical) {
+      cv.wait(lk, [&] { return exit || queue.size() < ENCODER_QUEUE_SIZE; });
+    } else if (queue.size() >= ENCODER_QUEUE_SIZE) {
+      ++dropped;
+      LOGW_100("encoder %s behind, dropped frame %d (%" PRIu64 " total)", encoder_info.publish_name, job.extra.frame_id, dropped);
+      return;
+    }
+    queue.push_back(std::move(job));
+    cv.notify_all();
+  }
+
+private:
+  void run() {
+    util::set_thread_name(util::string_format("%s_%s", cam_info.thread_name, encoder_info.publish_name).substr(0, 15).c_str());
+    int cur_seg = 0;
+    while (true) {
+      EncodeJob job;
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [&] { return exit || !queue.empty(); });
+        if (exit) break;
+        job = std::move(queue.front());
+        queue.pop_front();
+      }
+      cv.notify_all();
+
+      // the buffer may have been reused by camerad while queued
+      if (job.buf->get_frame_id() != job.extra.frame_id) {
+        LOGE_100("encoder %s lag  buffer id: %" PRIu64 " extra id: %d", encoder_info.publish_name, job.buf->get_frame_id(), job.extra.frame_id);
+        continue;
+      }
+
+      if (job.segment != cur_seg) {
+        encoder->encoder_close();
+        encoder->encoder_open();
+        cur_seg = job.segment;
+      }
+
+      if (encoder_info.is_live) {
+        encoder_update_live(*live_controls, encoder);
+      }
+
+      int out_id = encoder->encode_frame(job.buf, &job.extra, job.frame);
+      if (out_id == -1) {
+        LOGE("Failed to encode frame. frame_id: %d", job.extra.frame_id);
+      }
+    }
+  }
+
+  const LogCameraInfo &cam_info;
+  const EncoderInfo &encoder_info;
+  std::unique_ptr<Encoder> encoder;
+  const LivestreamControls *live_controls;
+  bool critical;
+  uint64_t dropped = 0;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<EncodeJob> queue;
+  bool exit = false;
+  std::thread thread;
+};
 
 void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.thread_name);
 
-  std::vector<std::unique_ptr<Encoder>> encoders;
-
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
 
+  std::unique_ptr<FramePreprocessor> preprocessor;
   std::unique_ptr<JpegEncoder> jpeg_encoder;
+  std::vector<std::unique_ptr<EncoderWorker>> workers;
 
   int cur_seg = 0;
   while (!do_exit) {
@@ -82,19 +201,23 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
     }
 
     // init encoders
-    if (encoders.empty()) {
+    if (workers.empty()) {
       const VisionBuf &buf_info = vipc_client.buffers[0];
       LOGW("encoder %s init %zux%zu", cam_info.thread_name, buf_info.width, buf_info.height);
       assert(buf_info.width > 0 && buf_info.height > 0);
 
+      // conversions needed by more than one encoder are done once per frame
+      preprocessor = std::make_unique<FramePreprocessor>(buf_info.width, buf_info.height);
       for (const auto &encoder_info : cam_info.encoder_infos) {
-        auto &e = encoders.emplace_back(new Encoder(encoder_info, buf_info.width, buf_info.height));
+        auto e = std::make_unique<Encoder>(encoder_info, buf_info.width, buf_info.height);
+        e->set_preprocessor(preprocessor.get());
         e->encoder_open();
+        workers.emplace_back(std::make_unique<EncoderWorker>(cam_info, encoder_info, buf_info.width, std::move(e), s->live_controls.get()));
       }
 
       // Only one thumbnail can be generated per camera stream
       if (auto thumbnail_name = cam_info.encoder_infos[0].thumbnail_name) {
-        jpeg_encoder = std::make_unique<JpegEncoder>(thumbnail_name, buf_info.width / 4, buf_info.height / 4);
+        jpeg_encoder = std::make_unique<JpegEncoder>(thumbnail_name, buf_info.width / 4, buf_info.height / 4, preprocessor.get());
       }
     }
 
@@ -122,32 +245,23 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       // do rotation if required
       const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
       if (cur_seg >= 0 && extra.frame_id >= ((cur_seg + 1) * frames_per_seg) + s->start_frame_id) {
-        for (auto &e : encoders) {
-          e->encoder_close();
-          e->encoder_open();
-        }
         ++cur_seg;
       }
 
-      // encode a frame
-      for (int i = 0; i < encoders.size(); ++i) {
-        if (cam_info.encoder_infos[i].is_live) {
-          encoder_set_bitrate(encoders[i]);
-          encoder_request_keyframe(encoders[i]);
-        }
-
-        int out_id = encoders[i]->encode_frame(buf, &extra);
-
-        if (out_id == -1) {
-          LOGE("Failed to encode frame. frame_id: %d", extra.frame_id);
-        }
+      // hand the frame to every encoder
+      FramePreprocessor::Frame frame = preprocessor->begin(buf);
+      for (auto &w : workers) {
+        w->push({buf, extra, frame, cur_seg});
       }
 
       if (jpeg_encoder && (extra.frame_id % 1200 == 100)) {
-        jpeg_encoder->pushThumbnail(buf, extra);
+        jpeg_encoder->pushThumbnail(buf, extra, frame);
       }
     }
   }
+
+  // stop the workers before the preprocessor they read from goes away
+  workers.clear();
 }
 
 template <size_t N>
@@ -170,6 +284,9 @@ void encoderd_thread(const LogCameraInfo (&cameras)[N]) {
                              [stream](auto &cam) { return cam.stream_type == stream; });
       assert(it != std::end(cameras));
       ++s.max_waiting;
+      if (!s.live_controls && std::any_of(it->encoder_infos.begin(), it->encoder_infos.end(), [](auto &e) { return e.is_live; })) {
+        s.live_controls = std::make_unique<LivestreamControls>();
+      }
       encoder_threads.push_back(std::thread(encoder_thread, &s, *it));
     }
 
@@ -23,6 +23,7 @@ public:
   inline const std::string& segmentPath() const { return segment_path; }
   inline const std::string& routeName() const { return route_name; }
   inline void write(kj::ArrayPtr<kj::byte> bytes, bool in_qlog) { write(bytes.begin(), bytes.size(), in_qlog); }
+  inline void writeQlog(uint8_t* data, size_t size) { qlog->write(data, size); }  // for messages already in the rlog
   inline void setExitSignal(int signal) { exit_signal = signal; }
 
 protected:
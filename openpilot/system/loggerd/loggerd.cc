@@ -1,7 +1,10 @@
 #include <sys/xattr.h>
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -9,12 +12,15 @@
 #include "common/params.h"
 #include "system/loggerd/encoder/encoder.h"
 #include "system/loggerd/loggerd.h"
+#include "system/loggerd/segment_syncer.h"
 #include "system/loggerd/video_writer.h"
 
 ExitHandler do_exit;
 
 struct LoggerdState {
+  SegmentSyncer syncer{SYNC_INTERVAL_MS};  // declared first so it finalizes after the logger closes
   LoggerState logger;
+  QlogDecimator qlog{qlog_burst_trigger, [this](uint8_t *data, size_t size) { logger.writeQlog(data, size); }};
   std::atomic<double> last_camera_seen_tms{0.0};
   std::atomic<int> ready_to_rotate{0};  // count of encoders ready to rotate
   int max_waiting = 0;
@@ -22,8 +28,10 @@ struct LoggerdState {
 };
 
 void logger_rotate(LoggerdState *s) {
+  s->qlog.flush();
   bool ret =s->logger.next();
   assert(ret);
+  s->syncer.rotate(s->logger.segmentPath());
   s->ready_to_rotate = 0;
   s->last_rotate_tms = millis_since_boot();
   LOGW((s->logger.segment() == 0) ? "logging to %s" : "rotated to %s", s->logger.segmentPath().c_str());
@@ -53,16 +61,73 @@ void rotate_if_needed(LoggerdState *s) {
   }
 }
 
+// fixed-capacity ring of encoder packets waiting for a rotation or audio init. the slots keep their
+// aligned buffers and readers, so queueing doesn't allocate once warmed up and packets aren't reparsed on flush.
+// slots only keep their buffers while all of them together stay below MAX_POOLED_BYTES, so a burst of
+// large packets isn't held on to for the life of loggerd
+class EncodePacketQueue {
+public:
+  static constexpr size_t MAX_POOLED_BYTES = 4 * 1024 * 1024;
+
+  struct Packet {
+    kj::Array<capnp::word> buf;
+    std::optional<capnp::FlatArrayMessageReader> reader;
+    cereal::Event::Reader event;
+    double queued_tms;
+  };
+
+  EncodePacketQueue(size_t capacity) : slots_(capacity) {}
+  inline bool empty() const { return count_ == 0; }
+  inline bool full() const { return count_ == slots_.size(); }
+  inline Packet &front() { return slots_[head_]; }
+
+  bool push(Message *msg) {
+    if (full()) return false;
+    Packet &p = slots_[(head_ + count_) % slots_.size()];
+    const size_t words = (msg->getSize() + sizeof(capnp::word) - 1) / sizeof(capnp::word);
+    if (p.buf.size() < words) {
+      pooled_bytes_ += (words - p.buf.size()) * sizeof(capnp::word);
+      p.buf = kj::heapArray<capnp::word>(words);
+    }
+    memcpy(p.buf.begin(), msg->getData(), msg->getSize());
+    p.reader.emplace(p.buf.slice(0, words));
+    p.event = p.reader->getRoot<cereal::Event>();
+    p.queued_tms = millis_since_boot();
+    ++count_;
+    return true;
+  }
+
+  void pop() {
+    Packet &p = slots_[head_];
+    p.reader.reset();
+    if (pooled_bytes_ > MAX_POOLED_BYTES) {
+      pooled_bytes_ -= p.buf.size() * sizeof(capnp::word);
+      p.buf = nullptr;
+    }
+    head_ = (head_ + 1) % slots_.size();
+    --count_;
+  }
+
+private:
+  std::vector<Packet> slots_;
+  size_t head_ = 0, count_ = 0;
+  size_t pooled_bytes_ = 0;
+};
+
 struct RemoteEncoder {
   std::unique_ptr<VideoWriter> writer;
   int encoderd_segment_offset;
   int current_segment = -1;
-  std::vector<Message *> q;
+  EncodePacketQueue q{MAIN_FPS*10};
   int dropped_frames = 0;
   bool recording = false;
   bool marked_ready_to_rotate = false;
   bool seen_first_packet = false;
   bool audio_initialized = false;
+
+  // queue metrics, reset every segment
+  int queue_drops = 0, queued_packets = 0;
+  double queue_max_ms = 0., queue_total_ms = 0.;
 };
 
 size_t write_encode_data(LoggerdState *s, cereal::Event::Reader event, RemoteEncoder &re, const EncoderInfo &encoder_info) {
@@ -112,6 +177,27 @@ size_t write_encode_data(LoggerdState *s, cereal::Event::Reader event, RemoteEnc
   return new_msg.size();
 }
 
+static void log_queue_stats(const std::string &name, RemoteEncoder &re) {
+  if (re.queue_drops > 0) {
+    LOGW("%s: queued %d packets (max %.1f ms), dropped %d", name.c_str(), re.queued_packets, re.queue_max_ms, re.queue_drops);
+  } else if (re.queued_packets > 0) {
+    LOGD("%s: queued %d packets (avg %.1f ms, max %.1f ms)", name.c_str(), re.queued_packets,
+         re.queue_total_ms / re.queued_packets, re.queue_max_ms);
+  }
+  re.queue_drops = re.queued_packets = 0;
+  re.queue_max_ms = re.queue_total_ms = 0.;
+}
+
+static void queue_encoder_msg(Message *msg, const std::string &name, RemoteEncoder &re, const char *reason) {
+  if (re.q.push(msg)) {
+    ++re.queued_packets;
+  } else {
+    ++re.queue_drops;
+    LOGE_100("%s: dropping frame %s, queue is full", name.c_str(), reason);
+  }
+  delete msg;
+}
+
 int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct RemoteEncoder &re, const EncoderInfo &encoder_info) {
   int bytes_count = 0;
 
@@ -147,23 +233,33 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
       re.current_segment = s->logger.segment();
       re.marked_ready_to_rotate = false;
     }
-    if (re.audio_initialized || !encoder_info.include_audio) {
+
+    // video takes priority over audio: once the queue is full, start the segment without waiting any longer
+    const bool audio_timed_out = encoder_info.include_audio && !re.audio_initialized && re.q.full();
+    if (audio_timed_out) {
+      LOGE_100("%s: audio not initialized, writing segment without audio", name.c_str());
+    }
+
+    if (re.audio_initialized || !encoder_info.include_audio || audio_timed_out) {
       // we are in this segment now, process any queued messages before this one
       if (!re.q.empty()) {
-        for (auto qmsg : re.q) {
-          capnp::FlatArrayMessageReader reader({(capnp::word *)qmsg->getData(), qmsg->getSize() / sizeof(capnp::word)});
-          bytes_count += write_encode_data(s, reader.getRoot<cereal::Event>(), re, encoder_info);
-          delete qmsg;
+        const double tms = millis_since_boot();
+        while (!re.q.empty()) {
+          auto &packet = re.q.front();
+          const double queued_ms = tms - packet.queued_tms;
+          re.queue_total_ms += queued_ms;
+          re.queue_max_ms = std::max(re.queue_max_ms, queued_ms);
+          bytes_count += write_encode_data(s, packet.event, re, encoder_info);
+          re.q.pop();
         }
-        re.q.clear();
+        // covers the wait that just ended, drops included
+        log_queue_stats(name, re);
       }
       bytes_count += write_encode_data(s, event, re, encoder_info);
       delete msg;
-    } else if (re.q.size() > MAIN_FPS*10) {
-      LOGE_100("%s: dropping frame waiting for audio initialization, queue is too large", name.c_str());
-      delete msg;
     } else {
-      re.q.push_back(msg); // queue up all the new segment messages, they go in after audio is initialized
+      // queue up all the new segment messages, they go in after audio is initialized
+      queue_encoder_msg(msg, name, re, "waiting for audio initialization");
     }
   } else if (offset_segment_num > s->logger.segment()) {
     // encoderd packet has a newer segment, this means encoderd has rolled over
@@ -175,14 +271,8 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
         s->ready_to_rotate.load(), s->max_waiting, name.c_str());
     }
 
-    // TODO: define this behavior, but for now don't leak
-    if (re.q.size() > MAIN_FPS*10) {
-      LOGE_100("%s: dropping frame, queue is too large", name.c_str());
-      delete msg;
-    } else {
-      // queue up all the new segment messages, they go in after the rotate
-      re.q.push_back(msg);
-    }
+    // queue up all the new segment messages, they go in after the rotate
+    queue_encoder_msg(msg, name, re, "waiting for rotation");
   } else {
     LOGE("%s: encoderd packet has a older segment!!! idx.getSegmentNum():%d s->logger.segment():%d re.encoderd_segment_offset:%d",
       name.c_str(), idx.getSegmentNum(), s->logger.segment(), re.encoderd_segment_offset);
@@ -201,28 +291,34 @@ void handle_preserve_segment(LoggerdState *s) {
 
   LOGW("preserving %s", s->logger.segmentPath().c_str());
 
+  // xattr and params writes happen on the sync thread
+  s->syncer.run([segment_path = s->logger.segmentPath(), route_name = s->logger.routeName()]() {
 #ifdef __APPLE__
-  int ret = setxattr(s->logger.segmentPath().c_str(), PRESERVE_ATTR_NAME, &PRESERVE_ATTR_VALUE, 1, 0, 0);
+    int ret = setxattr(segment_path.c_str(), PRESERVE_ATTR_NAME, &PRESERVE_ATTR_VALUE, 1, 0, 0);
 #else
-  int ret = setxattr(s->logger.segmentPath().c_str(), PRESERVE_ATTR_NAME, &PRESERVE_ATTR_VALUE, 1, 0);
+    int ret = setxattr(segment_path.c_str(), PRESERVE_ATTR_NAME, &PRESERVE_ATTR_VALUE, 1, 0);
 #endif
-  if (ret) {
-    LOGE("setxattr %s failed for %s: %s", PRESERVE_ATTR_NAME, s->logger.segmentPath().c_str(), strerror(errno));
-  }
+    if (ret) {
+      LOGE("setxattr %s failed for %s: %s", PRESERVE_ATTR_NAME, segment_path.c_str(), strerror(errno));
+    }
 
-  // mark route for uploading
-  Params params;
-  std::string routes = params.get("AthenadRecentlyViewedRoutes");
-  params.put("AthenadRecentlyViewedRoutes", routes + "," + s->logger.routeName());
+    // mark route for uploading
+    Params params;
+    std::string routes = params.get("AthenadRecentlyViewedRoutes");
+    params.put("AthenadRecentlyViewedRoutes", routes + "," + route_name);
+  });
 
   prev_segment = s->logger.segment();
 }
 
 void loggerd_thread() {
+  // outlives the encoders below, so the last segment's video files are closed before it's finalized
+  LoggerdState s;
+
   // setup messaging
   struct ServiceState {
     std::string name;
-    int counter, freq;
+    int qlog_handle;
     bool encoder, preserve_segment, record_audio;
   };
   std::unordered_map<SubSocket*, ServiceState> service_state;
@@ -242,10 +338,10 @@ void loggerd_thread() {
       SubSocket * sock = SubSocket::create(ctx.get(), it.name, "127.0.0.1", false, true, it.queue_size);
       assert(sock != NULL);
       poller->registerSocket(sock);
+      auto policy = qlog_policies.find(it.name);
       service_state[sock] = {
         .name = it.name,
-        .counter = 0,
-        .freq = it.decimation,
+        .qlog_handle = s.qlog.addService(it.name, it.decimation, policy != qlog_policies.end() ? policy->second : QlogPolicy{}),
         .encoder = encoder,
         .preserve_segment = it.name == "userBookmark",
         .record_audio = record_audio,
@@ -253,7 +349,6 @@ void loggerd_thread() {
     }
   }
 
-  LoggerdState s;
   // init logger
   logger_rotate(&s);
   Params().put("CurrentRoute", s.logger.routeName());
@@ -289,7 +384,16 @@ void loggerd_thread() {
       int count = 0;
       Message *msg = nullptr;
       while (!do_exit && (msg = sock->receive(true))) {
-        const bool in_qlog = service.freq != -1 && (service.counter++ % service.freq == 0);
+        bool in_qlog = false;
+        if (!service.encoder) {
+          if (s.qlog.parses(service.qlog_handle)) {
+            capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)));
+            auto event = cmsg.getRoot<cereal::Event>();
+            in_qlog = s.qlog.select(service.qlog_handle, (uint8_t *)msg->getData(), msg->getSize(), millis_since_boot(), &event);
+          } else {
+            in_qlog = s.qlog.select(service.qlog_handle, (uint8_t *)msg->getData(), msg->getSize(), millis_since_boot());
+          }
+        }
 
         if (service.record_audio) {
           capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)));
@@ -297,7 +401,8 @@ void loggerd_thread() {
           auto audio_data = event.getRawAudioData().getData();
           auto sample_rate = event.getRawAudioData().getSampleRate();
           for (auto* encoder : encoders_with_audio) {
-            if (encoder && encoder->writer) {
+            // the audio stream can't be added once the header is written without it
+            if (encoder && encoder->writer && (encoder->audio_initialized || !encoder->recording)) {
               encoder->writer->write_audio((uint8_t*)audio_data.begin(), audio_data.size(), event.getLogMonoTime() / 1000, sample_rate);
               encoder->audio_initialized = true;
             }
@@ -330,11 +435,12 @@ void loggerd_thread() {
   }
 
   LOGW("closing logger");
+  s.qlog.flush();
   s.logger.setExitSignal(do_exit.signal);
 
   if (do_exit.power_failure) {
     LOGE("power failure");
-    sync();
+    s.syncer.syncNow();
     LOGE("sync done");
   }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdlib>
+#include <map>
+#include <string>
 #include <vector>
 
 #include "openpilot/cereal/messaging/messaging.h"
@@ -13,6 +15,7 @@
 #include "common/util.h"
 
 #include "system/loggerd/logger.h"
+#include "system/loggerd/qlog_decimator.h"
 
 constexpr int MAIN_FPS = 20;
 const auto MAIN_ENCODE_TYPE = Hardware::PC() ? cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS : cereal::EncodeIndex::Type::FULL_H_E_V_C;
@@ -25,6 +28,8 @@ const auto MAIN_ENCODE_TYPE = Hardware::PC() ? cereal::EncodeIndex::Type::BIG_BO
 
 const bool LOGGERD_TEST = getenv("LOGGERD_TEST");
 const int SEGMENT_LENGTH = LOGGERD_TEST ? atoi(getenv("LOGGERD_SEGMENT_LENGTH")) : 60;
+// bounds data loss of the current segment on power cut
+const int SYNC_INTERVAL_MS = getenv("LOGGERD_SYNC_INTERVAL_MS") ? atoi(getenv("LOGGERD_SYNC_INTERVAL_MS")) : 5000;
 
 inline int livestream_width() {
   switch (Hardware::get_device_type()) {
@@ -42,6 +47,19 @@ inline int livestream_height() {
   }
 }
 
+// full rate qlogs for the controls stack around disengagements
+const QlogBurstTrigger qlog_burst_trigger = {.service = "selfdriveState", .field = "enabled", .pre_secs = 5., .post_secs = 5.};
+
+// per service qlog policies, services without an entry use their services.py decimation
+const std::map<std::string, QlogPolicy> qlog_policies = {
+  {"carState", {.burst = true}},
+  {"carControl", {.burst = true}},
+  {"carOutput", {.burst = true}},
+  {"controlsState", {.burst = true}},
+  {"selfdriveState", {.burst = true}},
+  {"longitudinalPlan", {.burst = true}},
+};
+
 constexpr char PRESERVE_ATTR_NAME[] = "user.preserve";
 constexpr char PRESERVE_ATTR_VALUE = '1';
 
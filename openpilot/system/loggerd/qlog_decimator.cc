@@ -0,0 +1,218 @@
+#include "system/loggerd/qlog_decimator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include <capnp/dynamic.h>
+
+#include "common/swaglog.h"
+
+constexpr size_t DELAY_LINE_BYTES = 2 * 1024 * 1024;  // per line, > pre_secs of controlsState at 100 Hz or of the whole qlog
+
+static bool read_field(const cereal::Event::Reader &event, const std::string &service, const std::string &path, double &out) {
+  try {
+    capnp::DynamicValue::Reader value = capnp::toDynamic(event).get(service);
+    std::istringstream stream(path);
+    std::string name;
+    while (std::getline(stream, name, '.')) {
+      value = value.as<capnp::DynamicStruct>().get(name);
+    }
+
+    switch (value.getType()) {
+      case capnp::DynamicValue::BOOL: out = value.as<bool>(); return true;
+      case capnp::DynamicValue::ENUM: out = value.as<capnp::DynamicEnum>().getRaw(); return true;
+      case capnp::DynamicValue::INT:
+      case capnp::DynamicValue::UINT:
+      case capnp::DynamicValue::FLOAT: out = value.as<double>(); return true;
+      default: return false;
+    }
+  } catch (const kj::Exception &e) {
+    return false;
+  }
+}
+
+QlogDecimator::QlogDecimator(const QlogBurstTrigger &trigger, WriteQlog write_qlog)
+    : trigger_(trigger), write_qlog_(std::move(write_qlog)) {
+  selected_.init(DELAY_LINE_BYTES);
+}
+
+int QlogDecimator::addService(const std::string &name, int decimation, const QlogPolicy &policy) {
+  ServiceState &s = services_.emplace_back();
+  s.name = name;
+  s.decimation = decimation;
+  s.policy = policy;
+  s.trigger = name == trigger_.service;
+  s.parse = s.trigger || !policy.changes.empty();
+  s.last_values.resize(policy.changes.size());
+  if (policy.burst) {
+    s.delayed.init(DELAY_LINE_BYTES);
+    burst_services_.push_back(services_.size() - 1);
+  }
+  return services_.size() - 1;
+}
+
+bool QlogDecimator::select(int handle, const uint8_t *data, size_t size, double tms, const cereal::Event::Reader *event) {
+  ServiceState &s = services_[handle];
+  assert(!s.parse || event != nullptr);
+
+  // everything that left the pre-event window goes out before anything newer
+  writeDelayed(0, tms - trigger_.pre_secs * 1000.);
+
+  if (s.trigger && triggered(s, *event)) {
+    LOGD("qlog burst triggered by %s", s.name.c_str());
+    startBurst(tms);
+  }
+
+  bool keep;
+  if (!s.policy.changes.empty()) {
+    keep = fieldsChanged(s, *event);
+  } else if (s.decimation != -1) {
+    keep = s.counter % s.decimation == 0;
+  } else {
+    keep = s.policy.max_hz > 0;
+  }
+  s.counter++;
+
+  if (keep && s.policy.max_hz > 0 && (tms - s.last_logged_tms) < 1000. / s.policy.max_hz) {
+    keep = false;
+  }
+  if (s.policy.burst && tms <= burst_until_tms_) {
+    keep = true;
+  }
+
+  if (keep) {
+    s.last_logged_tms = tms;
+    if (!s.policy.changes.empty()) {
+      // only commit the compared values once the message actually made it into the qlog
+      for (int i = 0; i < s.policy.changes.size(); ++i) {
+        read_field(*event, s.name, s.policy.changes[i].field, s.last_values[i]);
+      }
+      s.has_values = true;
+    }
+  }
+  if (s.policy.burst) {
+    return delay(s.delayed, data, size, tms, keep);
+  }
+  return keep && delay(selected_, data, size, tms, true);
+}
+
+bool QlogDecimator::fieldsChanged(ServiceState &s, const cereal::Event::Reader &event) {
+  if (!s.has_values) return true;
+
+  for (int i = 0; i < s.policy.changes.size(); ++i) {
+    const QlogFieldChange &change = s.policy.changes[i];
+    double value;
+    if (!read_field(event, s.name, change.field, value)) {
+      LOGE_100("qlog: failed to read %s.%s", s.name.c_str(), change.field.c_str());
+      return true;
+    }
+    if (std::abs(value - s.last_values[i]) >= change.threshold) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool QlogDecimator::triggered(ServiceState &s, const cereal::Event::Reader &event) {
+  double value;
+  if (!read_field(event, s.name, trigger_.field, value)) {
+    LOGE_100("qlog: failed to read burst trigger %s.%s", s.name.c_str(), trigger_.field.c_str());
+    return false;
+  }
+  const bool prev = s.prev_trigger_value;
+  s.prev_trigger_value = value != 0;
+  return prev && !s.prev_trigger_value;
+}
+
+void QlogDecimator::startBurst(double tms) {
+  // everything still delayed was received within the pre-event window
+  for (int handle : burst_services_) {
+    services_[handle].delayed.keepAll();
+  }
+  burst_until_tms_ = tms + trigger_.post_secs * 1000.;
+}
+
+bool QlogDecimator::delay(DelayLine &line, const uint8_t *data, size_t size, double tms, bool keep) {
+  const uint64_t seq = next_seq_++;
+  while (!line.push(seq, data, size, tms, keep)) {
+    if (line.empty()) {
+      // larger than the whole line, goes out right away after everything older
+      writeDelayed(seq, -1);
+      return keep;
+    }
+    // make room. messages of other services received before the evicted one go out first, so the order holds
+    writeDelayed(line.front().seq + 1, -1);
+  }
+  return false;
+}
+
+void QlogDecimator::writeDelayed(uint64_t seq, double tms) {
+  while (true) {
+    DelayLine *oldest = selected_.empty() ? nullptr : &selected_;
+    for (int handle : burst_services_) {
+      DelayLine &line = services_[handle].delayed;
+      if (!line.empty() && (!oldest || line.front().seq < oldest->front().seq)) {
+        oldest = &line;
+      }
+    }
+    if (!oldest || (oldest->front().seq >= seq && oldest->front().tms >= tms)) return;
+
+    const DelayedMessage &m = oldest->front();
+    if (m.keep) {
+      write_qlog_(oldest->data(m), m.size);
+    }
+    oldest->pop();
+  }
+}
+
+void QlogDecimator::flush() {
+  writeDelayed(std::numeric_limits<uint64_t>::max(), std::numeric_limits<double>::infinity());
+}
+
+bool QlogDecimator::DelayLine::push(uint64_t seq, const uint8_t *data, size_t size, double tms, bool keep) {
+  // the data goes right after the newest message, or at the start if it doesn't fit before the end
+  size_t offset = 0;
+  if (count_ > 0) {
+    const size_t head = front().offset;
+    const DelayedMessage &back = at(count_ - 1);
+    const size_t tail = back.offset + back.size;
+    if (tail > head && data_.size() - tail >= size) {
+      offset = tail;
+    } else if (tail > head && head >= size) {
+      offset = 0;
+    } else if (tail <= head && head - tail >= size) {
+      offset = tail;
+    } else {
+      return false;
+    }
+  } else if (size > data_.size()) {
+    return false;
+  }
+
+  if (count_ == entries_.size()) {
+    std::vector<DelayedMessage> grown(std::max<size_t>(entries_.size() * 2, 64));
+    for (size_t i = 0; i < count_; ++i) {
+      grown[i] = at(i);
+    }
+    entries_.swap(grown);
+    head_ = 0;
+  }
+  memcpy(data_.data() + offset, data, size);
+  at(count_++) = {seq, tms, offset, size, keep};
+  return true;
+}
+
+void QlogDecimator::DelayLine::pop() {
+  head_ = (head_ + 1) % entries_.size();
+  --count_;
+}
+
+void QlogDecimator::DelayLine::keepAll() {
+  for (size_t i = 0; i < count_; ++i) {
+    at(i).keep = true;
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "openpilot/cereal/messaging/messaging.h"
+
+// a numeric/bool/enum field, as a dotted path below the event union member, e.g. "vEgo" for carState
+struct QlogFieldChange {
+  std::string field;
+  double threshold;  // minimum absolute change since the last qlogged value
+};
+
+// qlog selection on top of the plain services.py decimation. with no policy, every
+// decimation-th message goes into the qlog like before.
+struct QlogPolicy {
+  float max_hz = 0;                       // rate-based: cap the qlog rate, 0 = no cap
+  std::vector<QlogFieldChange> changes;   // change-based: log only when a field moved beyond its threshold
+  bool burst = false;                     // log at full rate around burst events (e.g. disengagements)
+};
+
+// a bool field whose true -> false edge starts a burst window for all burst services
+struct QlogBurstTrigger {
+  std::string service;
+  std::string field;
+  double pre_secs;
+  double post_secs;
+};
+
+// Every qlog message waits pre_secs in a delay line, so a burst event can still pull in the messages
+// before it. Burst services keep all their messages in a line of their own, the selected messages
+// of everything else share one line. Messages leave the lines in receive order across services, so
+// the qlog stays in receive order like the rlog, it's just written pre_secs later.
+// The lines are flushed at a rotation, so a burst early in a segment only reaches back to its start.
+class QlogDecimator {
+public:
+  using WriteQlog = std::function<void(uint8_t *data, size_t size)>;
+  // write_qlog receives the delayed messages that were selected, they're already in the rlog
+  QlogDecimator(const QlogBurstTrigger &trigger, WriteQlog write_qlog);
+
+  // returns a handle to pass to select()
+  int addService(const std::string &name, int decimation, const QlogPolicy &policy);
+  bool parses(int handle) const { return services_[handle].parse; }
+
+  // decide whether a message goes into the qlog right away. event is only required when parses() is true.
+  // selected messages go through the delay lines, so this is only true for one that doesn't fit in
+  // its line. writes delayed messages older than pre_secs first
+  bool select(int handle, const uint8_t *data, size_t size, double tms, const cereal::Event::Reader *event = nullptr);
+
+  // writes the selected messages still in the delay lines and drops the rest. before a rotation,
+  // so they land in the qlog of the segment they were received in, and before closing
+  void flush();
+
+private:
+  struct DelayedMessage {
+    uint64_t seq;  // receive order across services
+    double tms;
+    size_t offset, size;
+    bool keep;
+  };
+
+  // preallocated byte ring, message data is stored contiguously. the entries only grow while warming up
+  class DelayLine {
+  public:
+    void init(size_t capacity) { data_.resize(capacity); }
+    bool empty() const { return count_ == 0; }
+    DelayedMessage &front() { return entries_[head_]; }
+    uint8_t *data(const DelayedMessage &m) { return data_.data() + m.offset; }
+    // false if there's no room until older messages are popped
+    bool push(uint64_t seq, const uint8_t *data, size_t size, double tms, bool keep);
+    void pop();
+    void keepAll();
+
+  private:
+    DelayedMessage &at(size_t i) { return entries_[(head_ + i) % entries_.size()]; }
+
+    std::vector<uint8_t> data_;
+    std::vector<DelayedMessage> entries_;
+    size_t head_ = 0, count_ = 0;
+  };
+
+  struct ServiceState {
+    std::string name;
+    int decimation;
+    QlogPolicy policy;
+    bool parse = false;
+    bool trigger = false;
+    uint64_t counter = 0;
+    double last_logged_tms = 0;
+    std::vector<double> last_values;
+    bool has_values = false;
+    bool prev_trigger_value = false;
+    DelayLine delayed;
+  };
+
+  bool fieldsChanged(ServiceState &service, const cereal::Event::Reader &event);
+  bool triggered(ServiceState &service, const cereal::Event::Reader &event);
+  void startBurst(double tms);
+  bool delay(DelayLine &line, const uint8_t *data, size_t size, double tms, bool keep);
+  // writes out delayed messages in receive order while they're older than seq or were received before tms
+  void writeDelayed(uint64_t seq, double tms);
+
+  QlogBurstTrigger trigger_;
+  WriteQlog write_qlog_;
+  double burst_until_tms_ = -1;
+  uint64_t next_seq_ = 0;
+  std::vector<ServiceState> services_;
+  std::vector<int> burst_services_;
+  DelayLine selected_;  // selected messages of the other services
+};
@@ -0,0 +1,216 @@
+#include "system/loggerd/segment_syncer.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+
+constexpr double FINALIZE_TIMEOUT_MS = 30 * 1000.;  // give up waiting for writers to close
+constexpr int MIN_INTERVAL_MS = 100;  // anything shorter is just a busy fdatasync loop
+
+static int data_sync(int fd) {
+#ifdef __APPLE__
+  return fsync(fd);
+#else
+  return fdatasync(fd);
+#endif
+}
+
+static bool sync_dir(const std::string &path) {
+  int fd = HANDLE_EINTR(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (fd < 0) return false;
+  int ret = fsync(fd);
+  close(fd);
+  return ret == 0;
+}
+
+// regular files in the segment, and whether a writer still holds a lock file
+static std::vector<std::string> list_segment(const std::string &path, bool *locked = nullptr) {
+  std::vector<std::string> files;
+  if (locked) *locked = false;
+
+  DIR *d = opendir(path.c_str());
+  if (!d) return files;
+  while (struct dirent *de = readdir(d)) {
+    if (de->d_type != DT_REG) continue;
+    if (util::ends_with(de->d_name, ".lock")) {
+      if (locked) *locked = true;
+      continue;
+    }
+    files.push_back(de->d_name);
+  }
+  closedir(d);
+  return files;
+}
+
+SegmentSyncer::SegmentSyncer(int interval_ms) : interval_ms_(std::max(interval_ms, MIN_INTERVAL_MS)) {
+  if (interval_ms < MIN_INTERVAL_MS) {
+    LOGW("sync interval %d ms is too short, using %d ms", interval_ms, MIN_INTERVAL_MS);
+  }
+  thread_ = std::thread(&SegmentSyncer::syncThread, this);
+}
+
+SegmentSyncer::~SegmentSyncer() {
+  {
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  closeFiles();
+}
+
+void SegmentSyncer::rotate(const std::string &segment_path) {
+  {
+    std::lock_guard lk(lock_);
+    if (!current_segment_.empty()) {
+      pending_segments_.push_back({current_segment_, millis_since_boot()});
+    }
+    current_segment_ = segment_path;
+  }
+  cv_.notify_one();
+}
+
+void SegmentSyncer::run(std::function<void()> job) {
+  {
+    std::lock_guard lk(lock_);
+    jobs_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+void SegmentSyncer::syncNow() {
+  syncPending(true);
+}
+
+void SegmentSyncer::syncThread() {
+  util::set_thread_name("loggerd_sync");
+
+  double last_sync_tms = millis_since_boot();
+  while (true) {
+    std::deque<std::function<void()>> jobs;
+    bool exiting;
+    {
+      std::unique_lock lk(lock_);
+      cv_.wait_for(lk, std::chrono::milliseconds(interval_ms_), [this] { return exit_ || !jobs_.empty(); });
+      jobs.swap(jobs_);
+      exiting = exit_;
+    }
+
+    for (auto &job : jobs) {
+      job();
+    }
+
+    const double tms = millis_since_boot();
+    if (exiting || (tms - last_sync_tms) >= interval_ms_) {
+      syncPending(exiting);
+      last_sync_tms = tms;
+    }
+
+    if (exiting) break;
+  }
+}
+
+// syncs the current segment and finalizes the rotated ones in order, stopping at the first one
+// that still has writers unless forced
+void SegmentSyncer::syncPending(bool force) {
+  std::lock_guard sync_lk(sync_lock_);
+  syncCurrent();
+
+  while (true) {
+    PendingSegment segment;
+    {
+      std::lock_guard lk(lock_);
+      if (pending_segments_.empty()) break;
+      segment = pending_segments_.front();
+    }
+    if (!finalize(segment, force)) break;
+    std::lock_guard lk(lock_);
+    pending_segments_.pop_front();
+  }
+}
+
+void SegmentSyncer::syncCurrent() {
+  std::string segment;
+  {
+    std::lock_guard lk(lock_);
+    segment = current_segment_;
+  }
+  if (segment.empty()) return;
+
+  if (segment != open_segment_) {
+    closeFiles();
+    open_segment_ = segment;
+  }
+
+  for (auto &name : list_segment(segment)) {
+    if (fds_.find(name) == fds_.end()) {
+      int fd = HANDLE_EINTR(open((segment + "/" + name).c_str(), O_RDONLY | O_CLOEXEC));
+      if (fd < 0) continue;
+      fds_[name] = fd;
+    }
+  }
+
+#ifdef __linux__
+  // start writeback on all files before waiting on any of them
+  for (auto &[name, fd] : fds_) {
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  }
+#endif
+  for (auto &[name, fd] : fds_) {
+    if (data_sync(fd) != 0) {
+      LOGE("fdatasync %s/%s failed: %s", segment.c_str(), name.c_str(), strerror(errno));
+    }
+  }
+  sync_dir(segment);
+}
+
+bool SegmentSyncer::finalize(const PendingSegment &segment, bool force) {
+  bool locked;
+  std::vector<std::string> files = list_segment(segment.path, &locked);
+  if (locked && !force) {
+    if ((millis_since_boot() - segment.rotated_tms) < FINALIZE_TIMEOUT_MS) return false;
+    LOGE("finalizing %s with open writers", segment.path.c_str());
+  }
+
+  std::string manifest;
+  for (auto &name : files) {
+    int fd = HANDLE_EINTR(open((segment.path + "/" + name).c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) continue;
+    struct stat st = {};
+    if (data_sync(fd) != 0 || fstat(fd, &st) != 0) {
+      LOGE("failed to sync %s/%s: %s", segment.path.c_str(), name.c_str(), strerror(errno));
+    }
+    close(fd);
+    manifest += util::string_format("%s %lld\n", name.c_str(), (long long)st.st_size);
+  }
+  sync_dir(segment.path);
+
+#ifdef __APPLE__
+  int ret = setxattr(segment.path.c_str(), MANIFEST_ATTR_NAME, manifest.data(), manifest.size(), 0, 0);
+#else
+  int ret = setxattr(segment.path.c_str(), MANIFEST_ATTR_NAME, manifest.data(), manifest.size(), 0);
+#endif
+  if (ret) {
+    LOGE("setxattr %s failed for %s: %s", MANIFEST_ATTR_NAME, segment.path.c_str(), strerror(errno));
+  }
+  sync_dir(segment.path);
+  LOGD("finalized %s", segment.path.c_str());
+  return true;
+}
+
+void SegmentSyncer::closeFiles() {
+  for (auto &[name, fd] : fds_) {
+    close(fd);
+  }
+  fds_.clear();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+constexpr char MANIFEST_ATTR_NAME[] = "user.manifest";
+
+// background durability for loggerd. the current segment's files are fdatasync'd every interval_ms,
+// and a rotated segment is finalized once its writers are closed: all files synced and a small
+// manifest ("<file> <size>" per line) stored as an xattr on the segment directory. other slow
+// filesystem work can be queued with run(), so none of it blocks the logging loop.
+class SegmentSyncer {
+public:
+  SegmentSyncer(int interval_ms);
+  ~SegmentSyncer();
+
+  void rotate(const std::string &segment_path);
+  void run(std::function<void()> job);
+  // blocking sync of the current segment, e.g. on power failure
+  void syncNow();
+
+private:
+  struct PendingSegment {
+    std::string path;
+    double rotated_tms;
+  };
+
+  void syncThread();
+  void syncPending(bool force);
+  void syncCurrent();
+  bool finalize(const PendingSegment &segment, bool force);
+  void closeFiles();
+
+  const int interval_ms_;
+  std::mutex lock_;
+  std::condition_variable cv_;
+  bool exit_ = false;
+  std::string current_segment_;
+  std::deque<PendingSegment> pending_segments_;
+  std::deque<std::function<void()>> jobs_;
+
+  // held for a whole sync and finalize pass, so only one caller finalizes a segment.
+  // open_segment_ and fds_ are only touched while holding it
+  std::mutex sync_lock_;
+  std::string open_segment_;
+  std::map<std::string, int> fds_;
+
+  std::thread thread_;
+};
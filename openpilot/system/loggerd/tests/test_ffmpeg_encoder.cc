@@ -0,0 +1,67 @@
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "system/loggerd/encoder/ffmpeg_encoder.h"
+
+// a live stream follows a bitrate change mid-segment, without waiting for the next reopen
+void test_live_bitrate_change() {
+  const int width = 640, height = 480;
+  EncoderInfo info = stream_road_encoder_info;
+  info.frame_width = 320;
+  info.frame_height = 240;
+
+  std::unique_ptr<Context> ctx(Context::create());
+  std::unique_ptr<SubSocket> sock(SubSocket::create(ctx.get(), info.publish_name, "127.0.0.1", false, true));
+  REQUIRE(sock);
+
+  VisionBuf buf;
+  buf.allocate(width * height * 3 / 2);
+  buf.init_yuv(width, height, width, width * height);
+
+  FfmpegEncoder encoder(info, width, height);
+  encoder.encoder_open();
+
+  // noise, so every frame costs whatever the rate control allows
+  std::mt19937 gen(0);
+  std::vector<size_t> sizes;
+  auto encode = [&](int frames) {
+    for (int i = 0; i < frames; ++i) {
+      for (size_t j = 0; j < buf.len; ++j) ((uint8_t *)buf.addr)[j] = gen();
+      VisionIpcBufExtra extra = {.frame_id = (uint32_t)sizes.size()};
+      REQUIRE(encoder.encode_frame(&buf, &extra) >= 0);
+      while (std::unique_ptr<Message> msg{sock->receive(true)}) {
+        capnp::FlatArrayMessageReader reader({(capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)});
+        auto event = reader.getRoot<cereal::Event>();
+        sizes.push_back((event.*(info.get_encode_data_func))().getData().size());
+      }
+    }
+  };
+  // average packet size over the last frames, after the lookahead has caught up with the change
+  auto recent_average = [&](size_t n) {
+    REQUIRE(sizes.size() >= n);
+    return std::accumulate(sizes.end() - n, sizes.end(), size_t(0)) / (double)n;
+  };
+
+  encoder.set_bitrate(2'000'000);
+  encode(100);
+  const double high = recent_average(30);
+
+  encoder.set_bitrate(200'000);
+  encode(100);
+  const double low = recent_average(30);
+  CHECK(low < high / 4);
+
+  encoder.set_bitrate(2'000'000);
+  encode(100);
+  CHECK(recent_average(30) > low * 4);
+
+  encoder.encoder_close();
+  buf.free();
+}
+
+int main() {
+  return run_native_test(test_live_bitrate_change);
+}
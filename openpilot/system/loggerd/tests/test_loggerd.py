@@ -284,6 +284,43 @@ class TestLoggerd(OpenpilotTestCase):
         expected_cnt = (len(msgs) - 1) // decimation + 1
         assert recv_cnt == expected_cnt, f"expected {expected_cnt} msgs for {s}, got {recv_cnt}"
 
+  def test_qlog_burst_around_disengagement(self):
+    services = ("carState", "selfdriveState", "deviceState")
+    pm = messaging.PubMaster(services)
+    managed_processes["loggerd"].start()
+    for s in services:
+      assert pm.wait_for_readers_to_update(s, timeout=5)
+
+    # 2s engaged, then 2s disengaged, all within the burst window around the disengagement
+    sent = 0
+    for i in range(400):
+      cs = messaging.new_message("carState")
+      cs.carState.vEgo = float(i)
+      pm.send("carState", cs)
+      sent += 1
+      if i % 10 == 0:
+        ss = messaging.new_message("selfdriveState")
+        ss.selfdriveState.enabled = i < 200
+        pm.send("selfdriveState", ss)
+      if i % 20 == 0:
+        pm.send("deviceState", messaging.new_message("deviceState"))
+      time.sleep(0.01)
+
+    for s in services:
+      assert pm.wait_for_readers_to_update(s, timeout=5)
+    managed_processes["loggerd"].stop()
+
+    lr = list(LogReader(os.path.join(self._get_latest_log_dir(), "qlog.zst")))
+    car_states = [m.carState.vEgo for m in lr if m.which() == "carState"]
+    # everything from before the disengagement is in, in the order it was sent
+    assert car_states == [float(i) for i in range(sent)]
+    assert len([m for m in lr if m.which() == "deviceState"]) == 400 // 20
+
+    # the qlog is in receive order across services, burst and decimated ones alike. loggerd reads
+    # socket by socket, so allow for a poll's worth of skew between services
+    mono_times = [m.logMonoTime for m in lr if m.which() in services]
+    assert all(b >= a - 50e6 for a, b in zip(mono_times, mono_times[1:], strict=False))
+
   def test_rlog(self):
     services = random.sample(CEREAL_SERVICES, random.randint(5, 10))
     sent_msgs = self._publish_random_messages(services)
@@ -0,0 +1,89 @@
+#include <fcntl.h>
+#include <sys/xattr.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "common/tests/native_test.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "system/loggerd/segment_syncer.h"
+
+const int INTERVAL_MS = 100;
+
+// the manifest lines of a finalized segment, empty if it isn't finalized
+static std::set<std::string> manifest(const std::string &path) {
+  char buf[4096];
+#ifdef __APPLE__
+  ssize_t size = getxattr(path.c_str(), MANIFEST_ATTR_NAME, buf, sizeof(buf), 0, 0);
+#else
+  ssize_t size = getxattr(path.c_str(), MANIFEST_ATTR_NAME, buf, sizeof(buf));
+#endif
+  std::set<std::string> lines;
+  if (size < 0) return lines;
+  std::istringstream stream(std::string(buf, size));
+  for (std::string line; std::getline(stream, line);) {
+    lines.insert(line);
+  }
+  return lines;
+}
+
+static bool wait_finalized(const std::string &path, int timeout_ms) {
+  const double start_tms = millis_since_boot();
+  while (manifest(path).empty()) {
+    if (millis_since_boot() - start_tms > timeout_ms) return false;
+    util::sleep_for(10);
+  }
+  return true;
+}
+
+static std::string make_segment(const std::string &dir, const std::string &name) {
+  const std::string path = dir + "/" + name;
+  REQUIRE(util::create_directories(path, 0775));
+  const std::pair<const char *, const char *> files[] = {{"rlog.zst", "abc"}, {"qcamera.ts", "abcde"}, {"qcamera.ts.lock", ""}};
+  for (auto &[file, data] : files) {
+    REQUIRE(util::write_file((path + "/" + file).c_str(), data, strlen(data), O_WRONLY | O_CREAT) == 0);
+  }
+  return path;
+}
+
+void test_segment_syncer() {
+  char dir_template[] = "/tmp/test_segment_syncer_XXXXXX";
+  REQUIRE(mkdtemp(dir_template) != nullptr);
+  const std::string dir = dir_template;
+  const std::set<std::string> expected = {"rlog.zst 3", "qcamera.ts 5"};
+
+  SegmentSyncer syncer(INTERVAL_MS);
+
+  // jobs run on the sync thread without waiting for the next interval
+  std::promise<void> ran;
+  syncer.run([&ran]() { ran.set_value(); });
+  CHECK(ran.get_future().wait_for(std::chrono::milliseconds(INTERVAL_MS)) == std::future_status::ready);
+
+  const std::string seg0 = make_segment(dir, "0"), seg1 = make_segment(dir, "1"), seg2 = make_segment(dir, "2");
+  syncer.rotate(seg0);
+  syncer.rotate(seg1);
+
+  // seg0 is rotated out, but its writer still holds the lock file
+  CHECK(!wait_finalized(seg0, INTERVAL_MS * 5));
+  remove((seg0 + "/qcamera.ts.lock").c_str());
+  REQUIRE(wait_finalized(seg0, INTERVAL_MS * 5));
+  CHECK(manifest(seg0) == expected);
+
+  // the current segment is never finalized, a rotated one is once forced even with its writer still open
+  syncer.rotate(seg2);
+  syncer.syncNow();
+  CHECK(manifest(seg1) == expected);
+  CHECK(manifest(seg2).empty());
+
+  util::check_system(("rm -rf " + dir).c_str());
+}
+
+int main() {
+  return run_native_test(test_segment_syncer);
+}
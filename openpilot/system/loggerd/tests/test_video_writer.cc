@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "common/tests/native_test.h"
+#include "common/util.h"
+#include "system/loggerd/video_writer.h"
+
+// every packet written before the destructor ends up in the file, including the ones still queued
+// when it runs. repeated, since a lost packet depends on the writer thread's timing at shutdown
+void test_destructor_drains() {
+  char dir_template[] = "/tmp/test_video_writer_XXXXXX";
+  REQUIRE(mkdtemp(dir_template) != nullptr);
+  const std::string dir = dir_template;
+
+  const int count = 1000, len = 1000;  // more than the queue holds, so write() also has to wait
+  std::vector<uint8_t> data(len);
+  for (int run = 0; run < 10; ++run) {
+    const std::string filename = "run" + std::to_string(run) + ".hevc";
+    {
+      VideoWriter writer(dir.c_str(), filename.c_str(), false, 1928, 1208, 20, cereal::EncodeIndex::Type::FULL_H_E_V_C);
+      for (int i = 0; i < count; ++i) {
+        std::fill(data.begin(), data.end(), i & 0xff);
+        writer.write(data.data(), len, i * 50000, i == 0, i % 20 == 0);
+      }
+    }
+
+    const std::string path = dir + "/" + filename;
+    const std::string written = util::read_file(path);
+    REQUIRE(written.size() == count * len);
+    for (int i = 0; i < count; ++i) {
+      CHECK((uint8_t)written[i * len] == (i & 0xff) && (uint8_t)written[(i + 1) * len - 1] == (i & 0xff));
+    }
+    CHECK(!util::file_exists(path + ".lock"));
+    remove(path.c_str());
+  }
+  remove(dir.c_str());
+}
+
+int main() {
+  return run_native_test(test_destructor_drains);
+}
@@ -1,9 +1,75 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "system/loggerd/video_writer.h"
 #include "common/swaglog.h"
 #include "common/util.h"
 
+size_t AudioRingBuffer::push(const float *samples, size_t n) {
+  const size_t capacity = buf.size();
+  size_t dropped = 0;
+  if (n > capacity) {
+    dropped += n - capacity;
+    samples += n - capacity;
+    n = capacity;
+  }
+  if (count + n > capacity) {
+    const size_t drop = count + n - capacity;
+    head = (head + drop) % capacity;
+    count -= drop;
+    dropped += drop;
+  }
+
+  const size_t tail = (head + count) % capacity;
+  const size_t first = std::min(n, capacity - tail);
+  memcpy(&buf[tail], samples, first * sizeof(float));
+  memcpy(&buf[0], samples + first, (n - first) * sizeof(float));
+  count += n;
+  return dropped;
+}
+
+void AudioRingBuffer::pop(float *out, size_t n) {
+  assert(n <= count);
+  const size_t first = std::min(n, buf.size() - head);
+  memcpy(out, &buf[head], first * sizeof(float));
+  memcpy(out + first, &buf[0], (n - first) * sizeof(float));
+  head = (head + n) % buf.size();
+  count -= n;
+}
+
+// s16le -> float in [-1, 1)
+static void s16_to_float(const int16_t *in, float *out, int n) {
+  constexpr float normalizer = 1.0f / 32768.0f;
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(normalizer);
+  for (; i + 8 <= n; i += 8) {
+    const __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+    // sign extend by placing each sample in the upper half of a 32 bit lane
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= n; i += 8) {
+    const int16x8_t s = vld1q_s16(in + i);
+    vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), normalizer));
+    vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), normalizer));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = in[i] * normalizer;
+  }
+}
+
 VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps, cereal::EncodeIndex::Type codec)
   : remuxing(remuxing) {
   vid_path = util::string_format("%s/%s", path, filename);
@@ -47,6 +113,31 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
     this->of = util::safe_fopen(this->vid_path.c_str(), "wb");
     assert(this->of);
   }
+
+  thread = std::thread(&VideoWriter::writer_thread, this);
+}
+
+void VideoWriter::push(Packet &&packet) {
+  if (!queue.try_push(std::move(packet))) {
+    LOGW("%s: writer queue full, waiting for disk", vid_path.c_str());
+    queue.push(std::move(packet));
+  }
+}
+
+void VideoWriter::writer_thread() {
+  util::set_thread_name("video_writer");
+
+  // the queue is FIFO, so every packet pushed before the destructor's last one gets written
+  Packet packet;
+  while (queue.pop(packet) && !packet.last) {
+    if (packet.audio) {
+      write_audio_samples(packet.data.data(), packet.data.size(), packet.timestamp, packet.sample_rate);
+    } else {
+      write_video_packet(packet.data.empty() ? nullptr : packet.data.data(), packet.data.size(),
+                         packet.timestamp, packet.codecconfig, packet.keyframe);
+    }
+    free_buffers.try_push(std::move(packet.data));
+  }
 }
 
 void VideoWriter::set_metadata(const char *key, const char *value) {
@@ -91,9 +182,58 @@ void VideoWriter::initialize_audio(int sample_rate) {
   this->audio_frame->nb_samples = this->audio_codec_ctx->frame_size;
   err = av_frame_get_buffer(this->audio_frame, 0);
   assert(err >= 0);
+
+  this->audio_buffer.reset(sample_rate * 10);  // 10 seconds
+}
+
+int VideoWriter::resample_audio(const int16_t *samples, int sample_count, int sample_rate) {
+  if (!swr_ctx || swr_in_rate != sample_rate) {
+    LOGW("AUDIO: resampling %d Hz to %d Hz", sample_rate, audio_codec_ctx->sample_rate);
+    swr_free(&swr_ctx);
+    #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)  // FFmpeg 5.1+
+    AVChannelLayout mono;
+    av_channel_layout_default(&mono, 1);
+    int err = swr_alloc_set_opts2(&swr_ctx, &mono, AV_SAMPLE_FMT_FLT, audio_codec_ctx->sample_rate,
+                                  &mono, AV_SAMPLE_FMT_S16, sample_rate, 0, NULL);
+    assert(err >= 0);
+    #else
+    swr_ctx = swr_alloc_set_opts(NULL, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, audio_codec_ctx->sample_rate,
+                                 AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, sample_rate, 0, NULL);
+    assert(swr_ctx);
+    #endif
+    int ret = swr_init(swr_ctx);
+    assert(ret >= 0);
+    swr_in_rate = sample_rate;
+  }
+
+  const int max_out = swr_get_out_samples(swr_ctx, sample_count);
+  audio_scratch.resize(std::max(max_out, 0));
+  uint8_t *out = reinterpret_cast<uint8_t *>(audio_scratch.data());
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(samples);
+  const int converted = swr_convert(swr_ctx, &out, max_out, &in, sample_count);
+  if (converted < 0) {
+    LOGW("AUDIO: resampling failed: %d", converted);
+    return 0;
+  }
+  return converted;
 }
 
 void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
+  Packet packet = {.timestamp = timestamp, .codecconfig = codecconfig, .keyframe = keyframe};
+  free_buffers.try_pop(packet.data);
+  if (data) packet.data.assign(data, data + len);
+  push(std::move(packet));
+}
+
+void VideoWriter::write_audio(uint8_t *data, int len, long long timestamp, int sample_rate) {
+  if (!remuxing) return;
+  Packet packet = {.audio = true, .timestamp = timestamp, .sample_rate = sample_rate};
+  free_buffers.try_pop(packet.data);
+  packet.data.assign(data, data + len);
+  push(std::move(packet));
+}
+
+void VideoWriter::write_video_packet(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
   if (of && data) {
     size_t written = util::safe_fwrite(data, 1, len, of);
     if (written != len) {
@@ -143,8 +283,7 @@ void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecc
   }
 }
 
-void VideoWriter::write_audio(uint8_t *data, int len, long long timestamp, int sample_rate) {
-  if (!remuxing) return;
+void VideoWriter::write_audio_samples(uint8_t *data, int len, long long timestamp, int sample_rate) {
   if (!audio_initialized) {
     initialize_audio(sample_rate);
     audio_initialized = true;
@@ -155,31 +294,26 @@ void VideoWriter::write_audio(uint8_t *data, int len, long long timestamp, int s
     audio_pts = (timestamp * audio_codec_ctx->sample_rate) / 1000000ULL;
   }
 
-  // convert s16le samples to fltp and add to buffer
+  // convert s16le samples to fltp at the encoder rate and add to buffer
   const int16_t *raw_samples = reinterpret_cast<const int16_t*>(data);
   int sample_count = len / sizeof(int16_t);
-  constexpr float normalizer = 1.0f / 32768.0f;
-
-  const size_t max_buffer_size = sample_rate * 10; // 10 seconds
-  if (audio_buffer.size() + sample_count > max_buffer_size) {
-    size_t samples_to_drop = (audio_buffer.size() + sample_count) - max_buffer_size;
-    LOGE("Audio buffer overflow, dropping %zu oldest samples", samples_to_drop);
-    audio_buffer.erase(audio_buffer.begin(), audio_buffer.begin() + samples_to_drop);
-    audio_pts += samples_to_drop;
+  if (sample_rate == audio_codec_ctx->sample_rate) {
+    audio_scratch.resize(sample_count);
+    s16_to_float(raw_samples, audio_scratch.data(), sample_count);
+  } else {
+    sample_count = resample_audio(raw_samples, sample_count, sample_rate);
   }
 
-  // Add new samples to the buffer
-  const size_t original_size = audio_buffer.size();
-  audio_buffer.resize(original_size + sample_count);
-  std::transform(raw_samples, raw_samples + sample_count, audio_buffer.begin() + original_size,
-                [](int16_t sample) { return sample * normalizer; });
+  const size_t samples_dropped = audio_buffer.push(audio_scratch.data(), sample_count);
+  if (samples_dropped > 0) {
+    LOGE("Audio buffer overflow, dropping %zu oldest samples", samples_dropped);
+    audio_pts += samples_dropped;
+  }
 
   if (!header_written) return; // header not written yet, process audio frame after header is written
   while (audio_buffer.size() >= audio_codec_ctx->frame_size) {
     audio_frame->pts = audio_pts;
-    float *f_samples = reinterpret_cast<float*>(audio_frame->data[0]);
-    std::copy(audio_buffer.begin(), audio_buffer.begin() + audio_codec_ctx->frame_size, f_samples);
-    audio_buffer.erase(audio_buffer.begin(), audio_buffer.begin() + audio_codec_ctx->frame_size);
+    audio_buffer.pop(reinterpret_cast<float*>(audio_frame->data[0]), audio_codec_ctx->frame_size);
     encode_and_write_audio_frame(audio_frame);
   }
 }
@@ -208,24 +342,29 @@ void VideoWriter::encode_and_write_audio_frame(AVFrame* frame) {
 
 void VideoWriter::process_remaining_audio() {
   // Process remaining audio samples by padding with silence
-  if (audio_buffer.size() > 0 && audio_buffer.size() < audio_codec_ctx->frame_size) {
-    audio_buffer.resize(audio_codec_ctx->frame_size, 0.0f);
+  const size_t remaining = audio_buffer.size();
+  if (remaining > 0 && remaining < audio_codec_ctx->frame_size) {
+    float *f_samples = reinterpret_cast<float *>(audio_frame->data[0]);
+    audio_buffer.pop(f_samples, remaining);
+    std::fill(f_samples + remaining, f_samples + audio_codec_ctx->frame_size, 0.0f);
 
     // Encode final frame
     audio_frame->pts = audio_pts;
-    float *f_samples = reinterpret_cast<float *>(audio_frame->data[0]);
-    std::copy(audio_buffer.begin(), audio_buffer.end(), f_samples);
     encode_and_write_audio_frame(audio_frame);
   }
 }
 
 VideoWriter::~VideoWriter() {
+  push({.last = true});
+  thread.join();
+
   if (this->remuxing) {
     if (this->audio_codec_ctx) {
       process_remaining_audio();
       encode_and_write_audio_frame(NULL); // flush encoder
       avcodec_free_context(&this->audio_codec_ctx);
     }
+    swr_free(&this->swr_ctx);
     int err = av_write_trailer(this->ofmt_ctx);
     if (err != 0) LOGE("av_write_trailer failed %d", err);
     avcodec_free_context(&this->codec_ctx);
@@ -1,15 +1,34 @@
 #pragma once
 
 #include <string>
-#include <deque>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
 }
 
 #include "openpilot/cereal/messaging/messaging.h"
+#include "common/queue.h"
 
+// fixed-size ring of mono float samples, pushes and pops are bulk copies of at most two chunks
+class AudioRingBuffer {
+public:
+  void reset(size_t capacity) { buf.assign(capacity, 0.0f); head = count = 0; }
+  inline size_t size() const { return count; }
+  // returns the number of oldest samples dropped to make room
+  size_t push(const float *samples, size_t n);
+  void pop(float *out, size_t n);
+
+private:
+  std::vector<float> buf;
+  size_t head = 0, count = 0;
+};
+
+// muxing and file I/O run on a writer thread per VideoWriter. write() and write_audio() copy the
+// packet into a pooled buffer and return, the destructor drains all queued packets before closing.
 class VideoWriter {
 public:
   VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps, cereal::EncodeIndex::Type codec);
@@ -20,7 +39,21 @@ public:
   ~VideoWriter();
 
 private:
+  struct Packet {
+    bool audio = false;
+    std::vector<uint8_t> data;
+    long long timestamp = 0;
+    bool codecconfig = false, keyframe = false;
+    int sample_rate = 0;
+    bool last = false;  // pushed by the destructor after everything else
+  };
+
+  void push(Packet &&packet);
+  void writer_thread();
+  void write_video_packet(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe);
+  void write_audio_samples(uint8_t *data, int len, long long timestamp, int sample_rate);
   void initialize_audio(int sample_rate);
+  int resample_audio(const int16_t *samples, int sample_count, int sample_rate);
   void encode_and_write_audio_frame(AVFrame* frame);
   void process_remaining_audio();
 
@@ -37,7 +70,14 @@ private:
   AVCodecContext *audio_codec_ctx = nullptr;
   AVFrame *audio_frame = nullptr;
   uint64_t audio_pts = 0;
-  std::deque<float> audio_buffer;
+  AudioRingBuffer audio_buffer;
+  std::vector<float> audio_scratch;
+  SwrContext *swr_ctx = nullptr;  // only when rawAudioData doesn't match the encoder sample rate
+  int swr_in_rate = 0;
 
   bool remuxing;
+
+  SPSCQueue<Packet> queue{256, QueueFullPolicy::Block};
+  SPSCQueue<std::vector<uint8_t>> free_buffers{256};  // returned by the writer thread for reuse
+  std::thread thread;
 };
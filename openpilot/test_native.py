@@ -6,17 +6,33 @@ from openpilot.common.parameterized import parameterized
 from openpilot.common.test import OpenpilotTestCase
 
 
+# executable and arguments
 NATIVE_TESTS = (
+  "openpilot/cereal/messaging/tests/test_bridge_stream",
+  "openpilot/cereal/messaging/tests/test_bridge_whitelist",
+  "openpilot/cereal/messaging/tests/test_message_builder",
+  "openpilot/cereal/messaging/tests/test_socketmaster",
+  "openpilot/common/tests/test_params",
+  "openpilot/common/tests/test_params_watcher",
+  "openpilot/common/tests/test_queue",
+  "openpilot/common/tests/test_ratekeeper",
   "openpilot/common/tests/test_swaglog",
+  "openpilot/common/tests/test_yuv",
   "openpilot/selfdrive/pandad/tests/test_pandad_canprotocol",
+  "openpilot/system/camerad/test/camerad_bench 20",
+  "openpilot/system/camerad/test/test_exposure",
+  "openpilot/system/loggerd/tests/test_ffmpeg_encoder",
+  "openpilot/system/loggerd/tests/test_segment_syncer",
+  "openpilot/system/loggerd/tests/test_video_writer",
   "openpilot/tools/cabana/tests/test_dbc_core",
 )
 
 
 class TestNative(OpenpilotTestCase):
   @parameterized.expand(NATIVE_TESTS)
-  def test_native(self, executable):
+  def test_native(self, command):
+    executable, *args = command.split()
     path = os.path.join(BASEDIR, executable)
     if not os.path.exists(path):
       self.skipTest(f"optional native test was not built: {executable}")
-    subprocess.run([path], check=True)
+    subprocess.run([path, *args], check=True)
@@ -54,7 +54,9 @@ void CameraServer::startVipcServer() {
 
 void CameraServer::cameraThread(Camera &cam) {
   while (true) {
-    const auto [fr, event] = cam.queue.pop();
+    std::pair<FrameReader*, const Event *> item;
+    cam.queue.pop(item);
+    const auto [fr, event] = item;
     if (!fr) break;
 
     capnp::FlatArrayMessageReader reader(event->data);
@@ -25,7 +25,8 @@ protected:
     int width;
     int height;
     std::thread thread;
-    SafeQueue<std::pair<FrameReader*, const Event *>> queue;
+    // a second of frames. when decoding falls behind, pushFrame() waits, every frame is published
+    SPSCQueue<std::pair<FrameReader*, const Event *>> queue{20, QueueFullPolicy::Block};
     std::set<VisionBuf *> cached_buf;
   };
   void startVipcServer();
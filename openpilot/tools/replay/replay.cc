@@ -236,7 +236,7 @@ void Replay::publishMessage(const Event *e) {
 
   if (!sm_) {
     auto bytes = e->data.asBytes();
-    int ret = pm_->send(sockets_[e->which], (capnp::byte *)bytes.begin(), bytes.size());
+    int ret = pm_->send(e->which, (capnp::byte *)bytes.begin(), bytes.size());
     if (ret == -1) {
       rWarning("stop publishing %s due to multiple publishers error", sockets_[e->which]);
       sockets_[e->which] = nullptr;